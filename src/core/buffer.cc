@@ -1,13 +1,47 @@
 #include <buffer.hh>
+#include <scan.hh>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
 #include <logger.hh>
 
 namespace eve
 {
 
+#define BUFFER_MAX_IOV 64
+
+/* spliced pieces smaller than this are copied, the chain stays short */
+#define BUFFER_MIN_SPLICE 512
+
+static thread_local size_t copied = 0;
+
+size_t buffer::copied_bytes()
+{
+    return copied;
+}
+
+buffer::buffer(buffer_mode mode)
+    : _mode(mode)
+{
+    if (_mode == BUFFER_CHAINED)
+        return;
+    _totallen = DEFAULT_BUF_SIZE;
+    _origin_buf = (unsigned char *)malloc(_totallen);
+    _buf = _origin_buf;
+}
+
+buffer::~buffer()
+{
+    free(_origin_buf);
+    for (size_t i = _chead; i < _chain.size(); i++)
+        __unref(_chain[i].seg);
+}
+
 void buffer::reset()
 {
     __drain(_off);
@@ -16,7 +50,8 @@ void buffer::reset()
 void buffer::resize(int n)
 {
     __drain(_off);
-    __expand(n);
+    if (_mode == BUFFER_CONTIGUOUS)
+        __expand(n);
 }
 
 /*
@@ -25,17 +60,11 @@ void buffer::resize(int n)
  */
 std::string buffer::readline()
 {
-    char *data = (char *)_buf;
-    unsigned int i;
-
-    for (i = 0; i < _off; i++)
-    {
-        if (data[i] == '\r' || data[i] == '\n')
-            break;
-    }
-
-    if (i == _off)
+    char *data = (char *)(_mode == BUFFER_CHAINED ? __pullup() : _buf);
+    const char *eol = scan_eol(data, _off);
+    if (!eol)
         return ""; /* not found */
+    size_t i = eol - data;
 
     int onemore = 0;
     if (i + 1 < _off) // check \r\n \n\r
@@ -55,6 +84,9 @@ std::string buffer::readline()
 /* add data to the end of buffer */
 int buffer::push_back(void *data, size_t datlen)
 {
+    if (_mode == BUFFER_CHAINED)
+        return __push_back_chained(data, datlen);
+
     size_t need = _off + _misalign + datlen;
     // size_t oldoff = _off;
 
@@ -64,6 +96,7 @@ int buffer::push_back(void *data, size_t datlen)
 
     std::memcpy(_buf + _off, data, datlen);
     _off += datlen;
+    copied += datlen;
 
     return 0;
 }
@@ -75,6 +108,31 @@ int buffer::push_back_buffer(std::unique_ptr<buffer> &inbuf, int datlen)
     int len = datlen;
     if (len > static_cast<int>(inbuf->_off) || datlen < 0)
         len = inbuf->_off;
+
+    if (_mode == BUFFER_CHAINED && inbuf->_mode == BUFFER_CHAINED && inbuf.get() != this)
+    {
+        __splice(inbuf.get(), len);
+        return 0;
+    }
+
+    if (_mode == BUFFER_CHAINED && len == static_cast<int>(inbuf->_off) && len >= BUFFER_MIN_SPLICE)
+        return __adopt(inbuf.get());
+
+    if (inbuf->_mode == BUFFER_CHAINED)
+    {
+        size_t left = len;
+        for (size_t i = inbuf->_chead; left > 0 && i < inbuf->_chain.size(); i++)
+        {
+            const chunk &c = inbuf->_chain[i];
+            size_t n = std::min(c.len, left);
+            if (push_back(c.seg->data + c.off, n) == -1)
+                return -1;
+            left -= n;
+        }
+        inbuf->__drain(len);
+        return 0;
+    }
+
     int res = push_back(inbuf->_buf, len);
     if (res == 0)
         inbuf->__drain(len);
@@ -87,7 +145,22 @@ size_t buffer::pop_front(void *data, size_t size)
 {
     if (_off < size)
         size = _off;
-    std::memcpy(data, _buf, size);
+
+    if (_mode == BUFFER_CHAINED)
+    {
+        unsigned char *p = (unsigned char *)data;
+        size_t left = size;
+        for (size_t i = _chead; left > 0; i++)
+        {
+            size_t n = std::min(_chain[i].len, left);
+            std::memcpy(p, _chain[i].seg->data + _chain[i].off, n);
+            p += n;
+            left -= n;
+        }
+    }
+    else
+        std::memcpy(data, _buf, size);
+    copied += size;
 
     if (size)
         __drain(size);
@@ -99,6 +172,56 @@ int buffer::readfd(int fd, int howmuch)
 {
     int n = BUFFER_MAX_READ;
 
+    if (_mode == BUFFER_CHAINED)
+    {
+        /* the free space of the tail segment first, the rest into a new one */
+        size_t space = 0;
+        unsigned char *tail = __tail_space(&space);
+        size_t want = howmuch < 0 ? space + BUFFER_SEGMENT_SIZE : howmuch;
+
+        struct iovec iov[2];
+        int niov = 0;
+        size_t intail = std::min(space, want);
+        if (intail > 0)
+        {
+            iov[niov].iov_base = tail;
+            iov[niov++].iov_len = intail;
+        }
+        segment *seg = nullptr;
+        if (want > intail)
+        {
+            if ((seg = __new_segment(std::max(want - intail, (size_t)BUFFER_SEGMENT_SIZE))) == nullptr)
+                return -1;
+            iov[niov].iov_base = seg->data;
+            iov[niov++].iov_len = want - intail;
+        }
+
+        n = readv(fd, iov, niov);
+        if (n == -1 || n == 0)
+        {
+            free(seg);
+            return n;
+        }
+
+        size_t rest = n;
+        if (intail > 0)
+        {
+            size_t k = std::min(intail, rest);
+            _chain.back().len += k;
+            _chain.back().seg->used += k;
+            rest -= k;
+        }
+        if (rest > 0)
+        {
+            seg->used = rest;
+            _chain.push_back(chunk{seg, 0, rest});
+        }
+        else
+            free(seg);
+        _off += n;
+        return n;
+    }
+
     if (howmuch < 0 || howmuch > n)
         howmuch = n;
 
@@ -114,9 +237,35 @@ int buffer::readfd(int fd, int howmuch)
     return n;
 }
 
-int buffer::writefd(int fd)
+int buffer::writefd(int fd, bool nosignal)
 {
-    int n = write(fd, _buf, _off);
+    if (_mode == BUFFER_CHAINED)
+    {
+        struct iovec iov[BUFFER_MAX_IOV];
+        int niov = 0;
+        for (size_t i = _chead; i < _chain.size() && niov < BUFFER_MAX_IOV; i++, niov++)
+        {
+            iov[niov].iov_base = _chain[i].seg->data + _chain[i].off;
+            iov[niov].iov_len = _chain[i].len;
+        }
+        int n;
+        if (nosignal)
+        {
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = niov;
+            n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        }
+        else
+            n = writev(fd, iov, niov);
+        if (n == -1 || n == 0)
+            return n;
+        __drain(n);
+        return n;
+    }
+
+    int n = nosignal ? send(fd, _buf, _off, MSG_NOSIGNAL) : write(fd, _buf, _off);
     if (n == -1 || n == 0)
         return n;
     __drain(n);
@@ -125,20 +274,16 @@ int buffer::writefd(int fd)
 
 unsigned char *buffer::find(unsigned char *what, size_t len)
 {
-    size_t remain = _off;
-    auto search = _buf;
-    unsigned char *p;
-
-    while ((p = (unsigned char *)memchr(search, *what, remain)) != nullptr && remain > len)
-    {
-        if (std::memcmp(p, what, len) == 0)
-            return (unsigned char *)p;
+    const char *data = (const char *)(_mode == BUFFER_CHAINED ? __pullup() : _buf);
+    const char *p;
 
-        search = p + 1;
-        remain = _off - (size_t)(search - _buf);
-    }
+    /* the end of a message head has a kernel of its own */
+    if (len == 4 && std::memcmp(what, "\r\n\r\n", 4) == 0)
+        p = scan_head_end(data, _off);
+    else
+        p = scan_find(data, _off, (const char *)what, len);
 
-    return nullptr;
+    return (unsigned char *)p;
 }
 
 /** private function **/
@@ -148,6 +293,12 @@ unsigned char *buffer::find(unsigned char *what, size_t len)
  */
 void buffer::__drain(size_t len)
 {
+    if (_mode == BUFFER_CHAINED)
+    {
+        __drain_chained(len);
+        return;
+    }
+
     if (len >= _off) // drain area bigger then buf to buf+off
     {
         _off = 0;
@@ -188,6 +339,7 @@ int buffer::__expand(size_t datlen)
 
         if (_origin_buf != _buf)
             __align();
+        copied += _off; // realloc may move the data
         if ((newbuf = (unsigned char *)realloc(_buf, length)) == nullptr)
         {
             LOG_ERROR << "realloc error";
@@ -205,6 +357,205 @@ void buffer::__align()
     std::memmove(_origin_buf, _buf, _off);
     _buf = _origin_buf;
     _misalign = 0;
+    copied += _off;
+}
+
+/** chained mode **/
+
+buffer::segment *buffer::__new_segment(size_t cap)
+{
+    segment *seg = (segment *)malloc(sizeof(segment) + cap);
+    if (!seg)
+    {
+        LOG_ERROR << "malloc error";
+        return nullptr;
+    }
+    seg->refcnt = 1;
+    seg->cap = cap;
+    seg->used = 0;
+    seg->data = (unsigned char *)(seg + 1);
+    return seg;
+}
+
+void buffer::__unref(segment *seg)
+{
+    if (--seg->refcnt > 0)
+        return;
+    if (seg->data != (unsigned char *)(seg + 1))
+        free(seg->data);
+    free(seg);
+}
+
+/*
+ * free space after the last chunk, only the view ending at the written
+ * end of its segment may grow, the others see disjoint parts of it
+ */
+unsigned char *buffer::__tail_space(size_t *space)
+{
+    *space = 0;
+    if (_chead == _chain.size())
+        return nullptr;
+    chunk &c = _chain.back();
+    if (c.off + c.len != c.seg->used)
+        return nullptr;
+    *space = c.seg->cap - c.seg->used;
+    return c.seg->data + c.seg->used;
+}
+
+int buffer::__push_back_chained(const void *data, size_t datlen)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t space = 0;
+    unsigned char *tail = __tail_space(&space);
+    size_t n = std::min(space, datlen);
+    if (n > 0)
+    {
+        std::memcpy(tail, p, n);
+        _chain.back().len += n;
+        _chain.back().seg->used += n;
+        _off += n;
+        copied += n;
+        p += n;
+        datlen -= n;
+    }
+
+    if (datlen > 0)
+    {
+        segment *seg = __new_segment(std::max(datlen, (size_t)BUFFER_SEGMENT_SIZE));
+        if (!seg)
+            return -1;
+        std::memcpy(seg->data, p, datlen);
+        seg->used = datlen;
+        _chain.push_back(chunk{seg, 0, datlen});
+        _off += datlen;
+        copied += datlen;
+    }
+    return 0;
+}
+
+/* move the first len bytes of inbuf to the end, whole chunks are relinked
+ * and a chunk cut in two is shared by both buffers */
+void buffer::__splice(buffer *inbuf, size_t len)
+{
+    while (len > 0)
+    {
+        chunk c = inbuf->_chain[inbuf->_chead];
+        size_t n = std::min(c.len, len);
+        if (n < BUFFER_MIN_SPLICE)
+            __push_back_chained(c.seg->data + c.off, n);
+        else
+        {
+            if (n < c.len)
+                c.seg->refcnt++;
+            _chain.push_back(chunk{c.seg, c.off, n});
+            _off += n;
+        }
+
+        if (n == c.len && n >= BUFFER_MIN_SPLICE) // the chunk moved over
+        {
+            inbuf->_chead++;
+            inbuf->_off -= n;
+            if (inbuf->_chead == inbuf->_chain.size())
+            {
+                inbuf->_chain.clear();
+                inbuf->_chead = 0;
+            }
+        }
+        else
+            inbuf->__drain_chained(n);
+        len -= n;
+    }
+}
+
+/* take over the array of a contiguous buffer as a segment, inbuf starts afresh */
+int buffer::__adopt(buffer *inbuf)
+{
+    segment *seg = (segment *)malloc(sizeof(segment));
+    unsigned char *fresh = (unsigned char *)malloc(DEFAULT_BUF_SIZE);
+    if (!seg || !fresh)
+    {
+        free(seg);
+        free(fresh);
+        LOG_ERROR << "malloc error";
+        return -1;
+    }
+
+    seg->refcnt = 1;
+    seg->cap = inbuf->_totallen;
+    seg->used = inbuf->_misalign + inbuf->_off;
+    seg->data = inbuf->_origin_buf;
+    _chain.push_back(chunk{seg, inbuf->_misalign, inbuf->_off});
+    _off += inbuf->_off;
+
+    inbuf->_origin_buf = inbuf->_buf = fresh;
+    inbuf->_totallen = DEFAULT_BUF_SIZE;
+    inbuf->_misalign = inbuf->_off = 0;
+    return 0;
+}
+
+void buffer::__drain_chained(size_t len)
+{
+    if (len >= _off)
+    {
+        for (size_t i = _chead; i < _chain.size(); i++)
+            __unref(_chain[i].seg);
+        _chain.clear();
+        _chead = 0;
+        _off = 0;
+        return;
+    }
+
+    _off -= len;
+    while (len > 0)
+    {
+        chunk &c = _chain[_chead];
+        if (c.len <= len)
+        {
+            len -= c.len;
+            __unref(c.seg);
+            _chead++;
+        }
+        else
+        {
+            c.off += len;
+            c.len -= len;
+            len = 0;
+        }
+    }
+
+    /* forget the consumed chunks once they are the bigger part */
+    if (_chead > 16 && _chead * 2 > _chain.size())
+    {
+        _chain.erase(_chain.begin(), _chain.begin() + _chead);
+        _chead = 0;
+    }
+}
+
+/* copy the chain into a single segment, get_data() of a const buffer too */
+unsigned char *buffer::__pullup() const
+{
+    static unsigned char empty[1] = {0};
+
+    size_t n = _chain.size() - _chead;
+    if (n == 0)
+        return empty;
+    if (n > 1)
+    {
+        segment *seg = __new_segment(std::max(_off, (size_t)BUFFER_SEGMENT_SIZE));
+        if (!seg)
+            return nullptr;
+        for (size_t i = _chead; i < _chain.size(); i++)
+        {
+            std::memcpy(seg->data + seg->used, _chain[i].seg->data + _chain[i].off, _chain[i].len);
+            seg->used += _chain[i].len;
+            copied += _chain[i].len;
+            __unref(_chain[i].seg);
+        }
+        _chain.clear();
+        _chain.push_back(chunk{seg, 0, seg->used});
+        _chead = 0;
+    }
+    return _chain[_chead].seg->data + _chain[_chead].off;
 }
 
 } // namespace eve
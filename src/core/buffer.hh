@@ -2,6 +2,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace eve
 {
@@ -10,31 +11,73 @@ namespace eve
 
 #define DEFAULT_BUF_SIZE 128
 
+#define BUFFER_SEGMENT_SIZE 16384
+
+enum buffer_mode
+{
+	BUFFER_CONTIGUOUS = 0, /* one realloc'd array */
+	BUFFER_CHAINED,		   /* list of refcounted segments */
+};
+
+/** class buffer **
+ * 	in chained mode the data is a list of views into refcounted segments.
+ * 	push_back_buffer() between two chained buffers relinks the segments
+ * 	instead of copying, and a whole contiguous buffer pushed into a chained
+ * 	one hands over its array as a segment. readfd() fills the tail segment
+ * 	and writefd() is one writev over the chain. get_data(), find() and
+ * 	readline() need the data in one piece and pull the chain up into a
+ * 	single segment first. **/
 class buffer
 {
   private:
-	unsigned char *_origin_buf;
-	unsigned char *_buf;
+	struct segment
+	{
+		int refcnt;
+		size_t cap;
+		size_t used; /* end of the data written into the segment */
+		unsigned char *data; /* follows the header, or the array of an adopted buffer */
+	};
+
+	struct chunk
+	{
+		segment *seg;
+		size_t off;
+		size_t len;
+	};
+
+	buffer_mode _mode = BUFFER_CONTIGUOUS;
+
+	unsigned char *_origin_buf = nullptr;
+	unsigned char *_buf = nullptr;
 	size_t _misalign = 0;
 	size_t _off = 0;
 	size_t _totallen = 0;
 
+	/* chained mode, get_data() pulls up the chain of a const buffer */
+	mutable std::vector<chunk> _chain;
+	mutable size_t _chead = 0; /* first chunk in use */
+
   private:
 	void __align();
 	int __expand(size_t datlen);
 	void __drain(size_t len);
 
+	static segment *__new_segment(size_t cap);
+	static void __unref(segment *seg);
+	unsigned char *__tail_space(size_t *space);
+	int __push_back_chained(const void *data, size_t datlen);
+	void __splice(buffer *inbuf, size_t len);
+	int __adopt(buffer *inbuf);
+	void __drain_chained(size_t len);
+	unsigned char *__pullup() const;
+
   public:
-	buffer()
-	{
-		_totallen = DEFAULT_BUF_SIZE;
-		_origin_buf = new unsigned char[_totallen];
-		_buf = _origin_buf;
-	}
-	~buffer()
-	{
-		delete _origin_buf;
-	}
+	buffer(buffer_mode mode = BUFFER_CONTIGUOUS);
+	~buffer();
+
+	buffer(const buffer &) = delete;
+	buffer &operator=(const buffer &) = delete;
+
 	void reset();
 	void resize(int n);
 	int remove(void *data, size_t datlen);
@@ -42,7 +85,7 @@ class buffer
 
 	/* operation with file descriptior */
 	int readfd(int fd, int howmuch);
-	int writefd(int fd);
+	int writefd(int fd, bool nosignal = false); /* nosignal: fd is a socket, MSG_NOSIGNAL instead of SIGPIPE */
 
 	/* push_back and pop_front */
 	int push_back(void *data, size_t datlen);
@@ -52,6 +95,7 @@ class buffer
 		return push_back((void *)s.c_str(), s.size());
 	}
 	size_t pop_front(void *data, size_t size);
+	inline void drain(size_t len) { __drain(len); }
 
 	unsigned char *find(unsigned char *what, size_t len);
 	inline unsigned char *find_string(const std::string & what)
@@ -59,9 +103,18 @@ class buffer
 		return find((unsigned char *)what.c_str(), what.length());
 	}
 
+	/* bytes this thread copied into, out of and inside buffers */
+	static size_t copied_bytes();
+
+	inline buffer_mode mode() const { return _mode; }
+	inline size_t chunk_count() const { return _chain.size() - _chead; }
+
 	inline int get_off() const { return _off; }
 	inline int get_length() const { return _off; }
-	inline const char *get_data() const { return (const char *)_buf; }
+	inline const char *get_data() const
+	{
+		return _mode == BUFFER_CHAINED ? (const char *)__pullup() : (const char *)_buf;
+	}
 };
 
 } // namespace eve
@@ -0,0 +1,216 @@
+#include <scan.hh>
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+namespace eve
+{
+
+/** scalar kernels, also the tails of the vector ones **/
+
+static const char *eol_scalar(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (data[i] == '\r' || data[i] == '\n')
+            return data + i;
+    return nullptr;
+}
+
+static const char *find_scalar(const char *data, size_t len, const char *what, size_t wlen)
+{
+    if (wlen == 0)
+        return data;
+    if (wlen > len)
+        return nullptr;
+
+    const char *end = data + len - wlen + 1; // last possible start + 1
+    const char *p = data;
+    while ((p = static_cast<const char *>(std::memchr(p, what[0], end - p))) != nullptr)
+    {
+        if (std::memcmp(p + 1, what + 1, wlen - 1) == 0)
+            return p;
+        p++;
+    }
+    return nullptr;
+}
+
+static const char *head_end_scalar(const char *data, size_t len)
+{
+    return find_scalar(data, len, "\r\n\r\n", 4);
+}
+
+#ifdef SCAN_X86
+
+/*
+ * the needle kernels compare the first and the last byte of every
+ * candidate position at once, only positions where both match get a
+ * memcmp. in header text that leaves almost none.
+ */
+
+__attribute__((target("sse2"))) static const char *eol_sse2(const char *data, size_t len)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask)
+            return data + i + __builtin_ctz(mask);
+    }
+    return eol_scalar(data + i, len - i);
+}
+
+__attribute__((target("sse2"))) static const char *find_sse2(const char *data, size_t len, const char *what, size_t wlen)
+{
+    if (wlen < 2 || wlen > len)
+        return find_scalar(data, len, what, wlen);
+
+    const __m128i first = _mm_set1_epi8(what[0]);
+    const __m128i last = _mm_set1_epi8(what[wlen - 1]);
+    size_t i = 0;
+    for (; i + wlen - 1 + 16 <= len; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + wlen - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if (std::memcmp(data + i + bit + 1, what + 1, wlen - 2) == 0)
+                return data + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data + i, len - i, what, wlen);
+}
+
+__attribute__((target("sse2"))) static const char *head_end_sse2(const char *data, size_t len)
+{
+    return find_sse2(data, len, "\r\n\r\n", 4);
+}
+
+__attribute__((target("avx2"))) static const char *eol_avx2(const char *data, size_t len)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask)
+            return data + i + __builtin_ctz(mask);
+    }
+    return eol_sse2(data + i, len - i);
+}
+
+__attribute__((target("avx2"))) static const char *find_avx2(const char *data, size_t len, const char *what, size_t wlen)
+{
+    if (wlen < 2 || wlen > len)
+        return find_scalar(data, len, what, wlen);
+
+    const __m256i first = _mm256_set1_epi8(what[0]);
+    const __m256i last = _mm256_set1_epi8(what[wlen - 1]);
+    size_t i = 0;
+    for (; i + wlen - 1 + 32 <= len; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + wlen - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if (std::memcmp(data + i + bit + 1, what + 1, wlen - 2) == 0)
+                return data + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(data + i, len - i, what, wlen);
+}
+
+__attribute__((target("avx2"))) static const char *head_end_avx2(const char *data, size_t len)
+{
+    return find_avx2(data, len, "\r\n\r\n", 4);
+}
+
+#endif // SCAN_X86
+
+/** dispatch **/
+
+struct scan_kernels
+{
+    scan_level level;
+    const char *(*eol)(const char *, size_t);
+    const char *(*head_end)(const char *, size_t);
+    const char *(*find)(const char *, size_t, const char *, size_t);
+};
+
+static const scan_kernels kernels[] = {
+    {SCAN_SCALAR, eol_scalar, head_end_scalar, find_scalar},
+#ifdef SCAN_X86
+    {SCAN_SSE2, eol_sse2, head_end_sse2, find_sse2},
+    {SCAN_AVX2, eol_avx2, head_end_avx2, find_avx2},
+#endif
+};
+
+static scan_level cpu_level()
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+static const scan_kernels *active()
+{
+    static const scan_kernels *k = &kernels[cpu_level()];
+    return k;
+}
+
+static const scan_kernels *forced = nullptr;
+
+static inline const scan_kernels *current()
+{
+    return forced ? forced : active();
+}
+
+const char *scan_eol(const char *data, size_t len)
+{
+    return current()->eol(data, len);
+}
+
+const char *scan_head_end(const char *data, size_t len)
+{
+    return current()->head_end(data, len);
+}
+
+const char *scan_find(const char *data, size_t len, const char *what, size_t wlen)
+{
+    return current()->find(data, len, what, wlen);
+}
+
+scan_level scan_get_level()
+{
+    return current()->level;
+}
+
+scan_level scan_set_level(scan_level level)
+{
+    if (level > cpu_level())
+        level = cpu_level();
+    forced = &kernels[level];
+    return level;
+}
+
+} // namespace eve
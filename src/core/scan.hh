@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+namespace eve
+{
+
+/* the widest kernels the cpu runs are picked on first use */
+enum scan_level
+{
+	SCAN_SCALAR = 0,
+	SCAN_SSE2,
+	SCAN_AVX2,
+};
+
+/* first '\r' or '\n' */
+const char *scan_eol(const char *data, size_t len);
+
+/* first "\r\n\r\n", the end of a message head */
+const char *scan_head_end(const char *data, size_t len);
+
+/* first occurrence of what */
+const char *scan_find(const char *data, size_t len, const char *what, size_t wlen);
+
+scan_level scan_get_level();
+/* for benchmarks and tests, capped at what the cpu supports */
+scan_level scan_set_level(scan_level level);
+
+} // namespace eve
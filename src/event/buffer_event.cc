@@ -1,19 +1,42 @@
 #include <buffer_event.hh>
 #include <event_base.hh>
+#include <logger.hh>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 namespace eve
 {
 
-buffer_event::buffer_event(std::shared_ptr<event_base> base, int fd)
+static bool is_nonblocking(int fd)
+{
+    int flags = fd == -1 ? -1 : fcntl(fd, F_GETFL);
+    return flags != -1 && (flags & O_NONBLOCK);
+}
+
+buffer_event::buffer_event(std::shared_ptr<event_base> base, int fd, buffer_mode mode)
     : base(base)
 {
-    input = std::unique_ptr<buffer>(new buffer);
-    output = std::unique_ptr<buffer>(new buffer);
+    input = std::unique_ptr<buffer>(new buffer(mode));
+    output = std::unique_ptr<buffer>(new buffer(mode));
     ev = std::make_shared<rw_event>(base, fd, NONE);
     base->register_callback(ev, rw_callback, this);
+    edge_triggered = base->is_edge_triggered();
+    nonblocking = is_nonblocking(fd);
 }
 buffer_event::~buffer_event()
 {
+    clear_file();
+}
+
+void buffer_event::set_fd(int fd)
+{
+    ev->set_fd(fd);
+    flushed = 0;
+    nonblocking = is_nonblocking(fd);
 }
 
 size_t buffer_event::write(void *data, size_t size)
@@ -24,7 +47,7 @@ size_t buffer_event::write(void *data, size_t size)
         return -1;
 
     if (size > 0)
-        add_write_event();
+        flush();
 
     return res;
 }
@@ -34,8 +57,149 @@ size_t buffer_event::read(void *data, size_t size)
     return input->pop_front(data, size);
 }
 
+int buffer_event::write_out()
+{
+    if (output->get_length() == 0)
+        return __write_file();
+
+    int res = output->writefd(ev->fd, nosignal);
+    if (res > 0 && output->get_length() == 0 && file_left > 0)
+    {
+        /* the headers are out, go on with the file while the socket takes it */
+        int n = __write_file();
+        if (n > 0)
+            res += n;
+        else if (n == -1 && errno != EAGAIN && errno != EINTR)
+            return -1;
+    }
+    return res;
+}
+
+/*
+ * the socket buffer is empty most of the time, so the output is written
+ * before the fd is asked. write interest is armed only for a remainder,
+ * writecb comes from the active queue as if the fd had been writable.
+ * a blocking fd would stall the loop in here, it waits for the loop.
+ */
+void buffer_event::flush()
+{
+    if (!has_pending_output())
+        return;
+    if (ev->fd == -1 || !nonblocking || ev->is_writeable()) // the output queued earlier goes first
+    {
+        add_write_event();
+        return;
+    }
+
+    size_t pending = output->get_length() + file_left;
+    counters.output_peak = std::max(counters.output_peak, pending);
+    int res = write_out();
+    if (res > 0)
+    {
+        counters.bytes_written += res;
+        counters.direct_writes++;
+    }
+    if (res == -1 || has_pending_output())
+    {
+        /* an error shows up again in rw_callback, which reports it */
+        if (res == -1 && errno == EAGAIN && edge_triggered)
+            ev->write_ready = false;
+        add_write_event();
+        return;
+    }
+
+    flushed = std::max(flushed, pending);
+    if (!in_callback && !ev->is_active())
+    {
+        ev->clear_active();
+        get_base()->activate(ev, 1);
+    }
+}
+
+void buffer_event::set_read_watermark(size_t low, size_t high)
+{
+    read_low = low;
+    read_high = high;
+    if (read_paused && (read_high == 0 || static_cast<size_t>(input->get_length()) < read_high))
+        add_read_event();
+}
+
+void buffer_event::set_write_watermark(size_t low, size_t high)
+{
+    write_low = low;
+    write_high = high;
+}
+
+void buffer_event::write_file(int fd, off_t offset, size_t length)
+{
+    clear_file();
+    if (length == 0)
+    {
+        ::close(fd);
+        return;
+    }
+    file_fd = fd;
+    file_offset = offset;
+    file_left = length;
+    add_write_event();
+}
+
+void buffer_event::clear_file()
+{
+    if (file_fd != -1)
+        ::close(file_fd);
+    file_fd = -1;
+    file_left = 0;
+}
+
+/* the file goes from the page cache to the socket, it never enters a buffer */
+int buffer_event::__write_file()
+{
+    if (file_left == 0)
+        return 0;
+
+    ssize_t n = sendfile(ev->fd, file_fd, &file_offset, file_left);
+    if (n == -1 && (errno == EINVAL || errno == ENOSYS))
+    {
+        /* no sendfile for this pair of files, read the next piece into the output buffer */
+        char block[BUFFER_SEGMENT_SIZE];
+        n = pread(file_fd, block, std::min(file_left, sizeof(block)), file_offset);
+        if (n > 0)
+        {
+            output->push_back(block, n);
+            file_offset += n;
+            file_left -= n;
+            n = output->writefd(ev->fd, nosignal);
+        }
+    }
+    else if (n > 0)
+        file_left -= n;
+
+    if (n == 0 && file_left > 0)
+    {
+        /* the file got shorter than announced, the message can not be completed */
+        LOG_ERROR << "file truncated with " << file_left << " bytes left to send on fd=" << ev->fd;
+        errno = EIO;
+        n = -1;
+    }
+    if (file_left == 0 || (n == -1 && errno != EAGAIN && errno != EINTR))
+        clear_file();
+    return n;
+}
+
 void buffer_event::add_read_event()
 {
+    if (read_high > 0 && static_cast<size_t>(input->get_length()) >= read_high)
+    {
+        /* the peer waits in its socket buffer until the input is consumed */
+        if (!read_paused)
+            counters.read_pauses++;
+        read_paused = true;
+        ev->disable_read();
+        get_base()->remove_event(ev);
+        return;
+    }
+    read_paused = false;
     ev->enable_read();
     get_base()->add_event(ev);
 }
@@ -48,28 +212,62 @@ void buffer_event::add_write_event()
 
 void buffer_event::remove_read_event()
 {
+    read_paused = false;
     ev->disable_read();
     get_base()->remove_event(ev);
 }
 
 void buffer_event::remove_write_event()
 {
+    if (!ev->is_writeable()) // dropped by the backend when it fired, or never armed
+        return;
     ev->disable_write();
     get_base()->remove_event(ev);
 }
 
+void buffer_event::__write_done()
+{
+    size_t pending = flushed;
+    flushed = 0;
+    if (drainedcb && pending > write_low)
+    {
+        counters.drains++;
+        (*drainedcb)();
+    }
+    if (writecb)
+        (*writecb)();
+}
+
 void buffer_event::rw_callback(buffer_event *bev)
 {
     int res = 0;
     auto ev = bev->ev;
+    if (ev->fd == -1)
+        return;
+    bev->in_callback = true;
     if (ev->is_read_active())
     {
         res = bev->read_in(); // -1 means read max
+        if (bev->edge_triggered)
+        {
+            /* no new edge comes before EAGAIN, eof and errors stay ready for the next read */
+            int n = res;
+            while (n > 0 && !(bev->read_high > 0 && static_cast<size_t>(bev->input->get_length()) >= bev->read_high))
+                if ((n = bev->read_in()) > 0)
+                    res += n;
+            ev->read_ready = !(n == -1 && errno == EAGAIN);
+        }
         if (res > 0)
         {
+            size_t len = bev->input->get_length();
+            bev->counters.bytes_read += res;
+            bev->counters.input_peak = std::max(bev->counters.input_peak, len);
             bev->add_read_event();
-            if (bev->readcb)
+            if (bev->readcb && len >= bev->read_low)
                 (*bev->readcb)();
+            /* what readcb consumed may let the reading go on */
+            if (bev->read_paused && static_cast<size_t>(bev->input->get_length()) < bev->read_high)
+                bev->add_read_event();
         }
         else
         {
@@ -90,11 +288,28 @@ void buffer_event::rw_callback(buffer_event *bev)
         }
     }
 
-    if (ev->is_write_active() && bev->get_obuf_length() > 0)
+    if (ev->is_write_active() && bev->has_pending_output())
     {
+        size_t pending = bev->output->get_length() + bev->file_left;
+        bev->counters.output_peak = std::max(bev->counters.output_peak, pending);
+        pending = std::max(pending, bev->flushed); // the writecb below is that of flush() too
+        bev->flushed = 0;
         res = bev->write_out();
+        if (bev->edge_triggered)
+        {
+            int n = res;
+            while (n > 0 && bev->has_pending_output())
+                if ((n = bev->write_out()) > 0)
+                    res += n;
+            ev->write_ready = !(n == -1 && errno == EAGAIN);
+        }
         if (res > 0)
-            bev->add_write_event();
+        {
+            bev->counters.bytes_written += res;
+            /* drained, an edge-triggered fd still writable would only be queued again */
+            if (bev->has_pending_output())
+                bev->add_write_event();
+        }
         else
         {
             if (res == 0)
@@ -108,9 +323,21 @@ void buffer_event::rw_callback(buffer_event *bev)
             if (bev->errorcb)
                 (*bev->errorcb)();
         }
+        /* before writecb, which may close the connection */
+        if (bev->drainedcb && pending > bev->write_low &&
+            bev->output->get_length() + bev->file_left <= bev->write_low)
+        {
+            bev->counters.drains++;
+            (*bev->drainedcb)();
+        }
         if (bev->writecb)
             (*bev->writecb)();
     }
+
+    /* flush() got everything out from the callbacks above or before the loop came here */
+    while (bev->flushed > 0 && ev->fd != -1)
+        bev->__write_done();
+    bev->in_callback = false;
 }
 
 } // namespace eve
@@ -1,13 +1,28 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 
+#include <sys/types.h>
+
 #include <rw_event.hh>
 #include <buffer.hh>
 
 namespace eve
 {
 
+/* what went through a buffer_event, the peaks are of the buffered bytes */
+struct buffer_event_stats
+{
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  size_t input_peak = 0;
+  size_t output_peak = 0;
+  uint32_t read_pauses = 0; /* times reading stopped at read_high */
+  uint32_t drains = 0;      /* times drainedcb was called */
+  uint32_t direct_writes = 0; /* flush() calls that found the fd writable */
+};
+
 class buffer_event
 {
 protected:
@@ -17,14 +32,36 @@ protected:
 
   std::weak_ptr<event_base> base;
 
+  bool edge_triggered = false; /* the fd has to be drained until EAGAIN */
+  bool nosignal = false;       /* the fd is a socket, a closed peer is EPIPE and no SIGPIPE */
+  bool nonblocking = false;    /* the fd is O_NONBLOCK, only then flush() writes right away */
+
+  /* a file range queued behind the output buffer, sent with sendfile() */
+  int file_fd = -1;
+  off_t file_offset = 0;
+  size_t file_left = 0;
+
+  /* watermarks, a high mark of 0 is off */
+  size_t read_low = 0;   /* readcb waits for this much input */
+  size_t read_high = 0;  /* the fd is not read while this much input is buffered */
+  size_t write_low = 0;  /* drainedcb once the output falls to this */
+  size_t write_high = 0; /* write_full() from here on */
+  bool read_paused = false; /* by read_high, not by remove_read_event() */
+
+  size_t flushed = 0;       /* what flush() wrote out completely, writecb is still due */
+  bool in_callback = false; /* rw_callback is on the stack and looks at flushed before it returns */
+
+  buffer_event_stats counters;
+
 public:
   std::shared_ptr<Callback> readcb = nullptr;
   std::shared_ptr<Callback> eofcb = nullptr;
   std::shared_ptr<Callback> writecb = nullptr;
   std::shared_ptr<Callback> errorcb = nullptr;
+  std::shared_ptr<Callback> drainedcb = nullptr;
 
 public:
-  buffer_event(std::shared_ptr<event_base> base, int fd);
+  buffer_event(std::shared_ptr<event_base> base, int fd, buffer_mode mode = BUFFER_CONTIGUOUS);
   ~buffer_event();
 
   template <typename F, typename... Rest>
@@ -55,16 +92,34 @@ public:
     errorcb = std::make_shared<Callback>([tsk]() { tsk(); });
   }
 
-  inline void set_fd(int fd) { ev->set_fd(fd); }
+  template <typename F, typename... Rest>
+  void register_drainedcb(F &&f, Rest &&... rest)
+  {
+    auto tsk = std::bind(std::forward<F>(f), std::forward<Rest>(rest)...);
+    drainedcb = std::make_shared<Callback>([tsk]() { tsk(); });
+  }
+
+  void set_fd(int fd); /* O_NONBLOCK is looked up here, set it before */
 
   inline int get_ibuf_length() const { return input->get_length(); }
   inline int get_obuf_length() const { return output->get_length(); }
+  inline size_t get_file_left() const { return file_left; }
+  inline bool has_pending_output() const { return output->get_length() > 0 || file_left > 0; }
   inline const char *get_ibuf_data() const { return input->get_data(); }
   inline const char *get_obuf_data() const { return output->get_data(); }
 
   inline std::unique_ptr<buffer> &get_ibuf() { return input; }
   inline std::unique_ptr<buffer> &get_obuf() { return output; }
 
+  void set_read_watermark(size_t low, size_t high);
+  void set_write_watermark(size_t low, size_t high);
+
+  /* a producer should wait for drainedcb before writing more */
+  inline bool write_full() const { return write_high > 0 && output->get_length() + file_left >= write_high; }
+  inline bool is_read_paused() const { return read_paused; }
+  inline void set_nosignal(bool on) { nosignal = on; }
+  inline const buffer_event_stats &stats() const { return counters; }
+
   std::shared_ptr<event_base> get_base()
   {
     auto b = base.lock();
@@ -78,12 +133,14 @@ public:
   size_t write(void *data, size_t size);
   size_t read(void *data, size_t size);
 
-  void add_read_event();
+  void add_read_event(); /* stays off while read_high is reached */
   void add_write_event();
   void remove_read_event();
   void remove_write_event();
 
-  inline int write_out() { return output->writefd(ev->fd); }
+  int write_out();
+  /* writes what the fd takes right away, only the rest waits for it to become writable. the fd has to be nonblocking */
+  void flush();
   inline int read_in() { return input->readfd(ev->fd, -1); }
 
   inline size_t write_string(const std::string &s)
@@ -96,7 +153,13 @@ public:
     output->push_back_buffer(buf, buf->get_length());
   }
 
+  /* the file fd is owned from now on and closed once sent */
+  void write_file(int fd, off_t offset, size_t length);
+  void clear_file();
+
 private:
+  int __write_file();
+  void __write_done();
   static void rw_callback(buffer_event *bev);
 };
 
@@ -1,26 +1,40 @@
 #include <epoll_base.hh>
 #include <rw_event.hh>
 
-#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 namespace eve
 {
 
-epoll_base::epoll_base()
+epoll_base::epoll_base(bool edge_triggered, int max_events)
+	: _edge_triggered(edge_triggered)
 {
-	struct rlimit rl;
-	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
-		_nfds = rl.rlim_cur;
-
 	if ((_epfd = epoll_create(1)) == -1)
 		LOG_ERROR << "epoll_create\n";
 
-	_epevents = new struct epoll_event[_nfds];
+	_epevents.resize(MIN_EVENTS);
+	_stats.capacity = MIN_EVENTS;
+	set_max_events(max_events);
 }
 
 epoll_base::~epoll_base()
 {
-	delete[] _epevents;
+	if (_epfd != -1)
+		close(_epfd);
+}
+
+void epoll_base::set_max_events(int max_events)
+{
+	_max_events = std::max(max_events, static_cast<int>(MIN_EVENTS));
+	_stats.max_capacity = _max_events;
+	if (static_cast<int>(_epevents.size()) > _max_events)
+	{
+		_epevents.resize(_max_events);
+		_epevents.shrink_to_fit();
+		_stats.capacity = _max_events;
+	}
 }
 
 int epoll_base::recalc()
@@ -30,16 +44,14 @@ int epoll_base::recalc()
 
 int epoll_base::dispatch(struct timeval *tv)
 {
-	if (evsignal_deliver() == -1)
-		return -1;
-
 	int timeout = -1;
 	if (tv)
 		timeout = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
-	int res = epoll_wait(_epfd, _epevents, _nfds, timeout);
-
-	if (evsignal_recalc() == -1)
-		return -1;
+	if (!_pending.empty()) // ready already, only collect new edges
+		timeout = 0;
+	__apply_changes();
+	int res = epoll_wait(_epfd, _epevents.data(), _epevents.size(), timeout);
+	_nwait++;
 
 	if (res == -1)
 	{
@@ -48,17 +60,22 @@ int epoll_base::dispatch(struct timeval *tv)
 			LOG_ERROR << "epoll_wait error";
 			return -1;
 		}
-		evsignal_process();
 		return 0;
 	}
-	else if (caught)
-		evsignal_process();
+
+	__resize_events(res); // keeps the res events just returned
+
+	if (_edge_triggered)
+		return __dispatch_edge(res);
 
 	int what = 0;
 	for (int i = 0; i < res; i++)
 	{
 		what = _epevents[i].events;
-		auto ev = fdMapRw.at(_epevents[i].data.fd);
+		auto e = static_cast<rw_event *>(_epevents[i].data.ptr);
+		if (fd_event(e->fd) != e) // removed by an earlier event of this round
+			continue;
+		auto ev = fdTableRw[e->fd];
 		if (what & (EPOLLHUP | EPOLLERR))
 			what |= (EPOLLIN | EPOLLOUT);
 
@@ -83,76 +100,250 @@ int epoll_base::dispatch(struct timeval *tv)
 
 int epoll_base::add(std::shared_ptr<rw_event> ev)
 {
+	if (_edge_triggered)
+		return __add_edge(ev);
+
+	/* what is registered stays, it is dropped by del() only */
+	__change(ev);
+	ev->change_in |= ev->is_readable();
+	ev->change_out |= ev->is_writeable();
+	return 0;
+}
+
+int epoll_base::del(std::shared_ptr<rw_event> ev)
+{
+	if (_edge_triggered) // the interest only lives in the rw_event
+		return 0;
+
+	/* drops the interest that is not enabled any more, never adds one */
+	__change(ev);
+	ev->change_in &= ev->is_readable();
+	ev->change_out &= ev->is_writeable();
+	return 0;
+}
+
+int epoll_base::release(std::shared_ptr<rw_event> ev)
+{
+	/* the fd is closed or reused next, the kernel has to know now */
+	if (!_edge_triggered)
+		return ev->epoll_changed ? __apply(ev.get()) : 0;
+	if (ev->epoll_fd == -1 || ev->epoll_fd != ev->fd)
+		return 0;
+
 	struct epoll_event epev = {0, {0}};
-	epev.data.fd = ev->fd;
-	int op = EPOLL_CTL_ADD;
+	int res = __ctl(EPOLL_CTL_DEL, ev->fd, &epev);
+	ev->epoll_fd = -1;
+	ev->read_ready = ev->write_ready = false;
+	return res;
+}
 
-	if (ev->epoll_in || ev->epoll_out)
-		op = EPOLL_CTL_MOD;
+/** private function **/
 
-	if (ev->epoll_in || ev->is_readable())
-		epev.events |= EPOLLIN;
-	if (ev->epoll_out || ev->is_writeable())
-		epev.events |= EPOLLOUT;
+int epoll_base::__ctl(int op, int fd, struct epoll_event *epev)
+{
+	_nctl++;
+	return epoll_ctl(_epfd, op, fd, epev);
+}
 
-	if (epoll_ctl(_epfd, op, ev->fd, &epev) == -1)
+void epoll_base::__change(const std::shared_ptr<rw_event> &ev)
+{
+	if (ev->epoll_changed)
 	{
-		LOG_ERROR << "epoll_ctl error";
-		return -1;
+		_nsaved++; // folded into the change listed before
+		return;
 	}
-
-	ev->epoll_in |= ev->is_readable();
-	ev->epoll_out |= ev->is_writeable();
-	return 0;
+	ev->epoll_changed = true;
+	ev->change_in = ev->epoll_in;
+	ev->change_out = ev->epoll_out;
+	_changes.push_back(ev);
 }
 
-int epoll_base::del(std::shared_ptr<rw_event> ev)
+/* one epoll_ctl for the net change of ev, none if it ends where it started */
+int epoll_base::__apply(rw_event *ev)
 {
+	ev->epoll_changed = false;
+	if (fd_event(ev->fd) != ev) // removed, or the base was cleaned up since
+		ev->change_in = ev->change_out = false;
+	if (ev->change_in == ev->epoll_in && ev->change_out == ev->epoll_out)
+	{
+		_nsaved++;
+		return 0;
+	}
+	if (ev->fd == -1)
+	{
+		ev->epoll_in = ev->epoll_out = false;
+		return 0;
+	}
+
 	struct epoll_event epev = {0, {0}};
-	epev.data.fd = ev->fd;
+	epev.data.ptr = ev;
+	if (ev->change_in)
+		epev.events |= EPOLLIN;
+	if (ev->change_out)
+		epev.events |= EPOLLOUT;
 
-	bool writedelete = true, readdelete = true;
+	int op = EPOLL_CTL_MOD;
+	if (!ev->epoll_in && !ev->epoll_out)
+		op = EPOLL_CTL_ADD;
+	else if (!epev.events)
+		op = EPOLL_CTL_DEL;
 
-	int op = EPOLL_CTL_DEL;
+	int res = __ctl(op, ev->fd, &epev);
+	if (res == -1 && op == EPOLL_CTL_ADD && errno == EEXIST) // registered by an rw_event the fd had before
+		res = __ctl(EPOLL_CTL_MOD, ev->fd, &epev);
+	if (res == -1 && op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF))
+		res = 0; // closed in the meantime, the kernel dropped it already
+	if (res == -1)
+		LOG_ERROR << "epoll_ctl error on fd=" << ev->fd << " errno=" << errno;
 
-	int events = 0;
+	ev->epoll_in = ev->change_in;
+	ev->epoll_out = ev->change_out;
+	return res;
+}
 
-	if (!ev->is_readable())
-		events |= EPOLLIN;
-	if (!ev->is_writeable())
-		events |= EPOLLOUT;
+int epoll_base::__apply_changes()
+{
+	int res = 0;
+	/* an rw_event gone in the meantime closed its fd, the kernel forgot it with that */
+	for (const auto &wev : _changes)
+	{
+		auto ev = wev.lock();
+		if (ev && ev->epoll_changed && __apply(ev.get()) == -1)
+			res = -1;
+	}
+	_changes.clear();
+	return res;
+}
 
-	if ((events & (EPOLLIN | EPOLLOUT)) != (EPOLLIN | EPOLLOUT))
+/* account a batch of res events and adapt the array for the next epoll_wait */
+void epoll_base::__resize_events(int res)
+{
+	int bucket = 0;
+	while (bucket < epoll_stats::BUCKETS - 1 && (1 << bucket) <= res)
+		bucket++;
+	_stats.batches[bucket]++;
+
+	int cap = _epevents.size();
+	if (res == cap)
 	{
-		if ((events & EPOLLIN) && ev->epoll_out)
+		_stats.full++;
+		_idle = 0;
+		if (cap < _max_events) // the events beyond are still ready, the next wait gets them
 		{
-			writedelete = false;
-			events = EPOLLOUT;
-			op = EPOLL_CTL_MOD;
+			cap = std::min(cap * 2, _max_events);
+			_epevents.resize(cap);
+			_stats.grows++;
 		}
-		else if ((events & EPOLLOUT) && ev->epoll_in)
+	}
+	else if (res <= cap / 4 && cap > MIN_EVENTS)
+	{
+		if (++_idle >= IDLE_WAITS)
 		{
-			readdelete = false;
-			events = EPOLLIN;
-			op = EPOLL_CTL_MOD;
+			_idle = 0;
+			cap /= 2;
+			_epevents.resize(cap);
+			_epevents.shrink_to_fit();
+			_stats.shrinks++;
 		}
 	}
+	else
+		_idle = 0;
+	_stats.capacity = cap;
+}
 
-	epev.events = events;
+int epoll_base::__add_edge(std::shared_ptr<rw_event> ev)
+{
+	if (ev->epoll_fd != ev->fd)
+	{
+		struct epoll_event epev = {0, {0}};
+		epev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		epev.data.ptr = ev.get();
 
-	if (writedelete)
-		ev->epoll_out = false;
-	if (readdelete)
-		ev->epoll_in = false;
+		int res = __ctl(EPOLL_CTL_ADD, ev->fd, &epev);
+		if (res == -1 && errno == EEXIST) // set_fd() with the fd it already had
+			res = __ctl(EPOLL_CTL_MOD, ev->fd, &epev);
+		if (res == -1)
+		{
+			LOG_ERROR << "epoll_ctl error with errno=" << errno;
+			return -1;
+		}
 
-	if (epoll_ctl(_epfd, op, ev->fd, &epev) == -1)
+		/* the kernel reports the current readiness as the first edge */
+		ev->epoll_fd = ev->fd;
+		ev->read_ready = ev->write_ready = false;
+		return 0;
+	}
+
+	/* the edge may have been seen before the interest was enabled */
+	if (!ev->epoll_pending && ((ev->read_ready && ev->is_readable()) || (ev->write_ready && ev->is_writeable())))
 	{
-		std::cout << "fd=" << ev->fd << std::endl;
-		LOG_ERROR << "epoll_ctl error with errno=" << errno;
-		return -1;
+		ev->epoll_pending = true;
+		_pending.push_back(ev);
 	}
+	return 0;
+}
 
+int epoll_base::__dispatch_edge(int res)
+{
+	for (int i = 0; i < res; i++)
+	{
+		auto ev = static_cast<rw_event *>(_epevents[i].data.ptr);
+		int what = _epevents[i].events;
+		if (what & (EPOLLHUP | EPOLLERR))
+			what |= (EPOLLIN | EPOLLOUT);
+
+		if (what & (EPOLLIN | EPOLLRDHUP))
+			ev->read_ready = true;
+		if (what & EPOLLOUT)
+			ev->write_ready = true;
+		__activate_ready(ev);
+	}
+
+	if (_pending.empty())
+		return 0;
+
+	auto pending = std::move(_pending);
+	_pending.clear();
+	for (const auto &ev : pending)
+	{
+		ev->epoll_pending = false;
+		__activate_ready(ev.get());
+	}
 	return 0;
 }
 
+/* activate the interests of ev the fd is known to be ready for */
+void epoll_base::__activate_ready(rw_event *ev)
+{
+	bool rd = ev->read_ready && ev->is_readable();
+	bool wr = ev->write_ready && ev->is_writeable();
+	if (!ev->alive || (!rd && !wr))
+		return;
+
+	if (fd_event(ev->fd) != ev)
+		return;
+	auto sev = fdTableRw[ev->fd];
+
+	/* already queued, the callback has not run yet and sees the new flags */
+	bool queued = ev->is_active();
+	if (!queued)
+		ev->clear_active();
+	/* an edge is handed to the callback once, it reports back what is left */
+	if (rd)
+	{
+		ev->read_ready = false;
+		ev->set_active_read();
+	}
+	if (wr)
+	{
+		ev->write_ready = false;
+		ev->set_active_write();
+	}
+
+	if (!ev->is_persistent())
+		remove_event(sev);
+	if (!queued)
+		activate(sev, 1);
+}
+
 } // namespace eve
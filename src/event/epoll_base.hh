@@ -4,25 +4,92 @@
 
 #include <sys/epoll.h>
 
+#include <vector>
+
 namespace eve
 {
 
 class rw_event;
+
+/* ready-list batches of epoll_wait, batches[0] counts empty returns and
+ * batches[i] the ones returning [2^(i-1), 2^i) events */
+struct epoll_stats
+{
+  static const int BUCKETS = 24;
+
+  size_t batches[BUCKETS] = {0};
+  size_t full = 0;   /* returns that filled the whole array */
+  size_t grows = 0;
+  size_t shrinks = 0;
+  int capacity = 0;  /* current size of the event array */
+  int max_capacity = 0;
+};
+
+/** class epoll_base **
+ * 	level-triggered by default, add() and del() only note the interest
+ * 	of an fd in a change list and the net change of each fd is applied
+ * 	before the next epoll_wait, so a callback that disables and enables
+ * 	again costs nothing. in edge-triggered mode every fd is
+ * 	registered once for IN|OUT and the interest toggled by add()/del()
+ * 	only lives in the rw_event, so enabling and disabling read or write
+ * 	costs no epoll_ctl. an edge is delivered to the callback once, the fd
+ * 	must be nonblocking and consumed until EAGAIN, otherwise the callback
+ * 	sets read_ready/write_ready again (buffer_event does both). an fd has
+ * 	to be cleaned (clean_rw_event) or closed before its rw_event gets
+ * 	another fd. **/
 class epoll_base : public event_base
 {
+public:
+  static const int MIN_EVENTS = 32;
+  static const int DEFAULT_MAX_EVENTS = 4096;
+
 private:
-  struct epoll_event *_epevents;
+  /* starts at MIN_EVENTS, doubles on a full batch up to the max and halves
+   * after IDLE_WAITS batches that would have fit into a quarter of it */
+  static const int IDLE_WAITS = 64;
+
+  std::vector<struct epoll_event> _epevents;
   int _epfd;
-  int _nfds;
+  int _max_events;
+  int _idle = 0;
+  epoll_stats _stats;
+
+  bool _edge_triggered = false;
+  std::vector<std::shared_ptr<rw_event>> _pending; /* enabled while already ready */
+  std::vector<std::weak_ptr<rw_event>> _changes; /* level-triggered, interest not registered yet */
+
+  size_t _nctl = 0; /* epoll_ctl calls */
+  size_t _nwait = 0; /* epoll_wait calls */
+  size_t _nsaved = 0; /* add()/del() the change list got away without an epoll_ctl for */
 
 public:
-  epoll_base();
+  epoll_base(bool edge_triggered = false, int max_events = DEFAULT_MAX_EVENTS);
   ~epoll_base();
 
   int add(std::shared_ptr<rw_event> ev);
   int del(std::shared_ptr<rw_event> ev);
+  int release(std::shared_ptr<rw_event> ev);
   int dispatch(struct timeval *tv);
   int recalc();
+
+  bool is_edge_triggered() const { return _edge_triggered; }
+
+  inline size_t ctl_count() const { return _nctl; }
+  inline size_t wait_count() const { return _nwait; }
+  inline size_t ctl_saved() const { return _nsaved; }
+  inline const epoll_stats &stats() const { return _stats; }
+
+  void set_max_events(int max_events);
+
+private:
+  int __ctl(int op, int fd, struct epoll_event *epev);
+  void __change(const std::shared_ptr<rw_event> &ev);
+  int __apply(rw_event *ev);
+  int __apply_changes();
+  void __resize_events(int res);
+  int __add_edge(std::shared_ptr<rw_event> ev);
+  int __dispatch_edge(int res);
+  void __activate_ready(rw_event *ev);
 };
 
 } // namespace eve
@@ -12,6 +12,7 @@
 #include <signal.h>
 
 #include <logger.hh>
+#include <event_callback.hh>
 
 namespace eve
 {
@@ -27,10 +28,20 @@ enum ERR
 	E_UNKNOW,
 };
 
+/* concrete type of an event, lets event_base dispatch without RTTI */
+enum KIND
+{
+	K_NONE = 0,
+	K_RW,
+	K_TIME,
+	K_SIGNAL,
+};
+
 class event
 {
   private:
 	static int _internal_event_id;
+	KIND _kind = K_NONE;
 	bool _persistent = false;
 	bool _active = false;
 
@@ -44,11 +55,20 @@ class event
 
 	bool alive = false;
 
+	event_callback callback; /* set by event_base::register_callback */
+
   public:
 	event() {}
 	event(std::shared_ptr<event_base> base);
 	virtual ~event() {}
 
+  protected:
+	explicit event(KIND kind) : _kind(kind) {}
+	event(std::shared_ptr<event_base> base, KIND kind) : event(base) { _kind = kind; }
+
+  public:
+	inline KIND kind() const { return _kind; }
+
 	virtual void init(std::shared_ptr<event> const &e);
 
 	void set_base(std::shared_ptr<event_base> base);
@@ -64,6 +84,9 @@ class event
 	inline bool is_persistent() const { return _persistent; }
 
 	void set_priority(int pri);
+
+	/* drop the bound arguments, needed when they hold this event itself */
+	inline void clear_callback() { callback.reset(); }
 };
 
 template <typename T, typename... Rest>
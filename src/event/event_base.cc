@@ -2,103 +2,243 @@
 #include <rw_event.hh>
 #include <signal_event.hh>
 #include <time_event.hh>
+#include <timer_wheel.hh>
 // #include <util_network.hh>
 #include <logger.hh>
 
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <string>
 #include <cstring>
+#include <cerrno>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 
 namespace eve
 {
 
-volatile sig_atomic_t event_base::caught = 0;
-std::vector<int> event_base::sigcaught = {};
-int event_base::needrecalc = 0;
+/*
+ * the handler of a signal is process wide while every base waiting for it
+ * keeps its own signalfd. sig_refs counts those bases, the first sets the
+ * handler and the last puts the old action back. sig_readers are the loop
+ * threads that block the signal, sig_owner the one a stray signal is sent
+ * on to, 0 if there is none yet. a signal that finds no owner is kept in
+ * sig_early for the first loop that blocks it.
+ */
+static std::mutex sig_mutex;
+static int sig_refs[NSIG];
+static struct sigaction sig_saved[NSIG];
+static std::vector<std::pair<const event_base *, pid_t>> sig_readers[NSIG];
+static std::atomic<pid_t> sig_owner[NSIG];
+static std::atomic<bool> sig_early[NSIG];
+
+/* the bases of this thread that block a signal, and whether it was unblocked before the first */
+static thread_local int sig_thread_refs[NSIG];
+static thread_local bool sig_thread_owned[NSIG];
+
+static inline pid_t current_tid()
+{
+	return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+/*
+ * a process-directed signal goes to any thread that does not block it,
+ * it is passed on to a thread that reads it. a thread id of an exited
+ * thread only makes tgkill fail.
+ */
+static void forward_signal(int sig)
+{
+	int saved_errno = errno;
+	pid_t tid = sig_owner[sig].load(std::memory_order_relaxed);
+	if (tid == 0)
+		sig_early[sig].store(true, std::memory_order_relaxed);
+	else if (tid != current_tid())
+		syscall(SYS_tgkill, getpid(), tid, sig);
+	errno = saved_errno;
+}
+
+/* under sig_mutex */
+static void __update_owner(int sig)
+{
+	sig_owner[sig].store(sig_readers[sig].empty() ? 0 : sig_readers[sig].front().second);
+}
+
+static void sig_ref(int sig)
+{
+	std::lock_guard<std::mutex> lock(sig_mutex);
+	if (sig_refs[sig]++ > 0)
+		return;
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = forward_signal;
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(sig, &sa, &sig_saved[sig]) == -1)
+		LOG_ERROR << "sigaction error";
+}
 
-bool cmp_timeev::operator()(std::shared_ptr<time_event> const &lhs, std::shared_ptr<time_event> const &rhs) const
+/* base no longer waits for sig */
+static void sig_unref(const event_base *base, int sig)
 {
-	return timercmp(&lhs->timeout, &rhs->timeout, <);
+	std::lock_guard<std::mutex> lock(sig_mutex);
+	auto &readers = sig_readers[sig];
+	readers.erase(std::remove_if(readers.begin(), readers.end(),
+								 [base](const std::pair<const event_base *, pid_t> &r) { return r.first == base; }),
+				  readers.end());
+	__update_owner(sig);
+	if (--sig_refs[sig] > 0)
+		return;
+	sig_early[sig].store(false);
+	if (sigaction(sig, &sig_saved[sig], nullptr) == -1)
+		LOG_ERROR << "sigaction error";
+}
+
+/* the loop of base blocks sig in thread tid */
+static void sig_read_in(const event_base *base, int sig, pid_t tid)
+{
+	std::lock_guard<std::mutex> lock(sig_mutex);
+	auto &readers = sig_readers[sig];
+	auto it = std::find_if(readers.begin(), readers.end(),
+						   [base](const std::pair<const event_base *, pid_t> &r) { return r.first == base; });
+	if (it != readers.end())
+		it->second = tid;
+	else
+		readers.emplace_back(base, tid);
+	__update_owner(sig);
 }
 
 event_base::event_base()
 {
 	priority_init(1); // default have 1 activequeues
+	timers = std::unique_ptr<timer_queue>(new timer_set);
 	sigemptyset(&evsigmask);
-
-	sigcaught.resize(NSIG);
+	sigemptyset(&_sig_blockset);
+	_sig_thread = pthread_self();
 }
 
 int event_base::add_event(const std::shared_ptr<event> &ev)
 {
-	ev->alive = true;
-	if (std::dynamic_pointer_cast<signal_event>(ev))
+	switch (ev->kind())
 	{
-		auto sigev = std::dynamic_pointer_cast<signal_event>(ev);
-		signalList.push_back(sigev);
-		return sigaddset(&evsigmask, sigev->sig);
+	case K_RW:
+		return add_event(std::static_pointer_cast<rw_event>(ev));
+	case K_TIME:
+		return add_event(std::static_pointer_cast<time_event>(ev));
+	case K_SIGNAL:
+		return add_event(std::static_pointer_cast<signal_event>(ev));
+	default:
+		LOG_ERROR << "no such event defined as " << typeid(*ev).name();
+		return -1;
 	}
-	else if (std::dynamic_pointer_cast<time_event>(ev))
+}
+
+int event_base::add_event(const std::shared_ptr<rw_event> &ev)
+{
+	ev->alive = true;
+	if (ev->is_removeable())
 	{
-		auto tev = std::dynamic_pointer_cast<time_event>(ev);
-		timeSet.insert(tev);
-		return 0;
+		LOG_WARN << "add rw event with no READ or WRITE, please use enble_read() or enblae_write()";
 	}
-	else if (std::dynamic_pointer_cast<rw_event>(ev))
+	if (ev->fd < 0)
 	{
-		auto rw = std::dynamic_pointer_cast<rw_event>(ev);
-		if (rw->is_removeable())
-		{
-			LOG_WARN << "add rw event with no READ or WRITE, please use enble_read() or enblae_write()";
-		}
-		fdMapRw[rw->fd] = rw;
-		return add(rw);
+		LOG_ERROR << "add rw event without fd";
+		return -1;
 	}
-	else
+	if (ev->fd >= static_cast<int>(fdTableRw.size()))
+		fdTableRw.resize(std::max<size_t>(ev->fd + 1, fdTableRw.size() * 2));
+	auto &slot = fdTableRw[ev->fd];
+	if (!slot)
+		_nrw++;
+	slot = ev;
+	return add(ev);
+}
+
+int event_base::add_event(const std::shared_ptr<time_event> &ev)
+{
+	ev->alive = true;
+	_ntimer_ops++;
+	timers->push(ev, now());
+	return 0;
+}
+
+int event_base::add_event(const std::shared_ptr<signal_event> &ev)
+{
+	if (ev->sig <= 0 || ev->sig >= NSIG)
 	{
-		LOG_ERROR << "no such event defined as " << typeid(ev).name();
+		LOG_ERROR << "sig not set";
 		return -1;
 	}
+	ev->alive = true;
+	signalList.push_back(ev);
+	if (!sigismember(&evsigmask, ev->sig))
+	{
+		sigaddset(&evsigmask, ev->sig);
+		sig_ref(ev->sig);
+	}
+	return __signalfd_update();
 }
 
 int event_base::remove_event(const std::shared_ptr<event> &ev)
 {
 	if (ev->alive == false)
 		return 1;
-	if (std::dynamic_pointer_cast<signal_event>(ev))
+	switch (ev->kind())
 	{
-		ev->alive = false;
-		auto sigev = std::dynamic_pointer_cast<signal_event>(ev);
-		signalList.remove(sigev);
-		sigdelset(&evsigmask, sigev->sig);
-		return sigaction(sigev->sig, (struct sigaction *)SIG_DFL, nullptr);
+	case K_RW:
+		return remove_event(std::static_pointer_cast<rw_event>(ev));
+	case K_TIME:
+		return remove_event(std::static_pointer_cast<time_event>(ev));
+	case K_SIGNAL:
+		return remove_event(std::static_pointer_cast<signal_event>(ev));
+	default:
+		LOG_ERROR << "no such event defined as " << typeid(*ev).name();
+		return -1;
 	}
-	else if (std::dynamic_pointer_cast<time_event>(ev))
-	{
-		ev->alive = false;
-		auto tev = std::dynamic_pointer_cast<time_event>(ev);
-		timeSet.erase(tev);
+}
+
+int event_base::remove_event(const std::shared_ptr<rw_event> &ev)
+{
+	if (ev->alive == false)
+		return 1;
+	if (!fd_event(ev->fd))
 		return 0;
-	}
-	else if (std::dynamic_pointer_cast<rw_event>(ev))
+	int res = del(ev);
+	if (ev->is_removeable())
 	{
-		auto rw = std::dynamic_pointer_cast<rw_event>(ev);
-		if (fdMapRw.count(rw->fd) == 0)
-			return 0;
-		int res = del(rw);
-		if (rw->is_removeable())
-		{
-			fdMapRw.erase(rw->fd);
-			rw->alive = false;
-		}
-		return res;
+		fdTableRw[ev->fd] = nullptr;
+		_nrw--;
+		ev->alive = false;
 	}
-	else
+	return res;
+}
+
+int event_base::remove_event(const std::shared_ptr<time_event> &ev)
+{
+	if (ev->alive == false)
+		return 1;
+	ev->alive = false;
+	_ntimer_ops++;
+	timers->erase(ev);
+	return 0;
+}
+
+int event_base::remove_event(const std::shared_ptr<signal_event> &ev)
+{
+	if (ev->alive == false)
+		return 1;
+	ev->alive = false;
+	signalList.remove(ev);
+	int sig = ev->sig;
+	if (std::none_of(signalList.begin(), signalList.end(),
+					 [sig](const std::shared_ptr<signal_event> &e) { return e->sig == sig; }))
 	{
-		LOG_ERROR << "no such event defined as " << typeid(ev).name();
-		return -1;
+		sigdelset(&evsigmask, sig);
+		__signal_release(sig);
 	}
+	return __signalfd_update();
 }
 
 void event_base::clean_rw_event(const std::shared_ptr<rw_event> &ev)
@@ -106,8 +246,8 @@ void event_base::clean_rw_event(const std::shared_ptr<rw_event> &ev)
 	ev->disable_read();
 	ev->disable_write();
 	remove_event(ev);
+	release(ev);
 	ev->alive = false;
-	// callbackMap.erase(ev->id);
 }
 
 void event_base::activate(std::shared_ptr<event> ev, short ncalls)
@@ -142,13 +282,39 @@ int event_base::priority_init(int npriorities)
 	return 0;
 }
 
+int event_base::set_timer_backend(timer_backend backend)
+{
+	if (!timers->empty())
+	{
+		LOG_ERROR << "can not change timer backend with pending time events";
+		return -1;
+	}
+
+	if (backend == TIMER_WHEEL)
+		timers = std::unique_ptr<timer_queue>(new timer_wheel);
+	else
+		timers = std::unique_ptr<timer_queue>(new timer_set);
+	return 0;
+}
+
 int event_base::loop()
 {
+	_looping = true;
 	int res = __loop();
+	_looping = false;
+	_now_cached = false;
 	__clean_up();
 	return res;
 }
 
+void event_base::__read_clock()
+{
+	struct timespec ts;
+	clock_gettime(_clock, &ts);
+	_now.tv_sec = ts.tv_sec;
+	_now.tv_usec = ts.tv_nsec / 1000;
+}
+
 int event_base::__loop()
 {
 	/* Calculate the initial events that we are waiting for */
@@ -170,13 +336,13 @@ int event_base::__loop()
 		int nactive_events = active_event_size();
 
 		/* If we have no events, we just exit */
-		if (signalList.empty() && timeSet.empty() && !rw_event_size() && !nactive_events)
+		if (signalList.empty() && timers->empty() && !rw_event_size() && !nactive_events)
 		{
 			LOG << "[event] have no events, just exit";
 			return 1;
 		}
 
-		int res;
+		int res = 0;
 		struct timeval off;
 		if (_loop_nonblock) // non block
 		{
@@ -185,18 +351,17 @@ int event_base::__loop()
 		}
 		else if (!nactive_events)
 		{
-			if (timeSet.empty()) // no time event
+			struct timeval deadline;
+			if (!timers->next_timeout(&deadline)) // no time event
 				res = this->dispatch(nullptr);
 			else // has time event
 			{
-				struct timeval now;
-				gettimeofday(&now, nullptr);
-				auto tev = *timeSet.begin();
-				if (timercmp(&(tev->timeout), &now, >)) // no time event time out
-				{
-					timersub(&(tev->timeout), &now, &off);
-					res = this->dispatch(&off);
-				}
+				update_time();
+				if (timercmp(&deadline, &_now, >)) // no time event time out
+					timersub(&deadline, &_now, &off);
+				else
+					timerclear(&off);
+				res = this->dispatch(&off);
 			}
 		}
 
@@ -205,8 +370,9 @@ int event_base::__loop()
 			LOG_ERROR << "[event] dispatch exit res=" << res;
 			return -1;
 		}
+		update_time(); // for the timers and the callbacks of this iteration
 
-		if (!timeSet.empty())
+		if (!timers->empty())
 			process_timeout_events();
 
 		if (active_event_size())
@@ -227,30 +393,27 @@ int event_base::__loop()
 
 void event_base::__clean_up()
 {
-	callbackMap.clear();
-
 	int n = activeQueues.size();
 	activeQueues.clear();
 	activeQueues.resize(n);
 	signalList.clear();
-	timeSet.clear();
-	fdMapRw.clear();
+	timers->clear();
+	fdTableRw.clear();
+	_nrw = 0;
+
+	for (int sig = 1; sig < NSIG; sig++)
+		if (sigismember(&evsigmask, sig) == 1)
+			__signal_release(sig);
+	sigemptyset(&evsigmask);
+	_sig_blocked = false;
+	_sigfd_ev = nullptr; // closes the signalfd
 }
 
 void event_base::process_timeout_events()
 {
-	struct timeval now;
-	gettimeofday(&now, nullptr);
-
-	auto i = timeSet.begin();
-	while (i != timeSet.end())
-	{
-		auto ev = *i;
-		if (timercmp(&ev->timeout, &now, >))
-			break;
-		i = timeSet.erase(i);
+	std::shared_ptr<time_event> ev;
+	while ((ev = timers->pop_expired(now())) != nullptr)
 		activate(ev, 1);
-	}
 }
 
 void event_base::process_active_events()
@@ -267,13 +430,12 @@ void event_base::process_active_events()
 		auto ev = q.front();
 		q.pop();
 
-		auto f = callbackMap[ev->id];
-		if (f)
+		if (ev->callback)
 		{
 			while (ev->ncalls)
 			{
 				--ev->ncalls;
-				(*f)();
+				ev->callback();
 			}
 		}
 
@@ -282,75 +444,119 @@ void event_base::process_active_events()
 }
 
 /** deal with signal **/
+
+/* the signalfd is readable, every event of a signal is called as often as it came */
 void event_base::evsignal_process()
 {
-	short ncalls;
+	short sigcaught[NSIG] = {0};
+	struct signalfd_siginfo si[8];
+	ssize_t n;
+	while ((n = read(_sigfd_ev->fd, si, sizeof(si))) > 0)
+		for (size_t k = 0; k < n / sizeof(si[0]); k++)
+			if (si[k].ssi_signo < NSIG)
+				sigcaught[si[k].ssi_signo]++;
+
 	auto i = signalList.begin();
 	while (i != signalList.end())
 	{
-		auto ev = *i;
-		ncalls = sigcaught[ev->sig];
+		auto ev = *i++;
+		short ncalls = sigcaught[ev->sig];
 		if (ncalls)
 		{
 			if (!(ev->is_persistent()))
-				i = signalList.erase(i);
+				remove_event(ev);
 			activate(ev, ncalls);
 		}
-		i++;
 	}
-
-	std::fill(sigcaught.begin(), sigcaught.end(), 0);
-	caught = 0;
 }
 
+/*
+ * blocks the signals of the signalfd in the thread running the loop,
+ * again only when the thread or the signals changed
+ */
 int event_base::evsignal_recalc()
 {
-	if (signalList.empty() && !needrecalc)
+	if (signalList.empty() || (_sig_blocked && pthread_equal(_sig_thread, pthread_self())))
 		return 0;
-	needrecalc = 0;
-	if (sigprocmask(SIG_BLOCK, &evsigmask, nullptr) == -1)
+	sigset_t old;
+	if (pthread_sigmask(SIG_BLOCK, &evsigmask, &old) != 0)
 	{
 		LOG_ERROR << "sigprocmask error";
 		return -1;
 	}
-
-	struct sigaction sa;
-	/* Reinstall our signal handler. */
-	std::memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = this->handler;
-	sa.sa_mask = this->evsigmask;
-	sa.sa_flags |= SA_RESTART;
-
-	for (const auto &ev : signalList)
+	if (!pthread_equal(_sig_thread, pthread_self()))
+		sigemptyset(&_sig_blockset);
+	_sig_thread = pthread_self();
+	_sig_blocked = true;
+	pid_t tid = current_tid();
+	for (int sig = 1; sig < NSIG; sig++)
 	{
-		if (ev->sig < 0 || ev->sig >= NSIG)
-		{
-			LOG_ERROR << "sig not set";
-			exit(-1);
-		}
-		if (sigaction(ev->sig, &sa, nullptr) == -1)
+		if (sigismember(&evsigmask, sig) != 1)
+			continue;
+		if (sigismember(&_sig_blockset, sig) != 1)
 		{
-			LOG_ERROR << "sigaction error";
-			return -1;
+			sigaddset(&_sig_blockset, sig);
+			if (sig_thread_refs[sig]++ == 0)
+				sig_thread_owned[sig] = sigismember(&old, sig) != 1;
 		}
+		sig_read_in(this, sig, tid);
+		/* one that came before anybody blocked it is read from the signalfd like the others */
+		if (sig_early[sig].exchange(false))
+			pthread_kill(_sig_thread, sig);
 	}
 	return 0;
 }
 
-int event_base::evsignal_deliver()
+/*
+ * this base no longer waits for sig. the loop thread unblocks it again
+ * when no other base of the thread needs it and it was not blocked before,
+ * so a pending one gets the action that is back now.
+ */
+void event_base::__signal_release(int sig)
 {
-	if (signalList.empty())
-		return 0;
-	int res = sigprocmask(SIG_UNBLOCK, &evsigmask, nullptr);
-	if (res == -1)
-		LOG_ERROR << "sigprocmask error";
-	return res;
+	sig_unref(this, sig);
+	if (sigismember(&_sig_blockset, sig) != 1)
+		return;
+	sigdelset(&_sig_blockset, sig);
+	if (!pthread_equal(_sig_thread, pthread_self()) || --sig_thread_refs[sig] > 0 || !sig_thread_owned[sig])
+		return;
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, sig);
+	pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
 }
 
-void event_base::handler(int sig)
+int event_base::__signalfd_update()
 {
-	sigcaught[sig]++;
-	caught = 1;
+	if (signalList.empty())
+	{
+		if (_sigfd_ev)
+		{
+			clean_rw_event(_sigfd_ev);
+			_sigfd_ev = nullptr; // closes the signalfd
+		}
+		return 0;
+	}
+
+	int fd = signalfd(_sigfd_ev ? _sigfd_ev->fd : -1, &evsigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+	{
+		LOG_ERROR << "signalfd error errno=" << errno;
+		return -1;
+	}
+	if (!_sigfd_ev)
+	{
+		_sigfd_ev = std::make_shared<rw_event>();
+		_sigfd_ev->pri = 0;
+		_sigfd_ev->set_fd(fd);
+		_sigfd_ev->set_type(READ);
+		_sigfd_ev->set_persistent();
+		register_callback(_sigfd_ev, &event_base::evsignal_process, this);
+		add_event(_sigfd_ev);
+	}
+	/* outside the loop the signals are blocked by recalc() when it starts */
+	_sig_blocked = false;
+	return _looping ? evsignal_recalc() : 0;
 }
 
 } // namespace eve
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <vector>
 #include <list>
@@ -12,6 +14,9 @@
 #include <utility>
 #include <functional>
 #include <memory>
+#include <type_traits>
+
+#include <timer_queue.hh>
 
 namespace eve
 {
@@ -21,13 +26,46 @@ class event;
 class rw_event;
 class signal_event;
 class time_event;
-struct cmp_timeev;
 
-struct cmp_timeev
+template <typename T>
+struct is_event_ptr : std::false_type
+{
+};
+template <typename U>
+struct is_event_ptr<std::shared_ptr<U>> : std::is_base_of<event, U>
+{
+};
+
+/*
+ * an event bound as an argument of its own callback. the callback lives
+ * inside the event, a strong reference would keep both alive for good.
+ */
+template <typename U>
+class bound_event
 {
-	bool operator()(std::shared_ptr<time_event> const &lhs, std::shared_ptr<time_event> const &rhs) const;
+  private:
+	std::shared_ptr<U> strong;
+	std::weak_ptr<U> weak;
+
+  public:
+	bound_event(const event *self, const std::shared_ptr<U> &ev)
+	{
+		if (static_cast<const event *>(ev.get()) == self)
+			weak = ev;
+		else
+			strong = ev;
+	}
+
+	template <typename V>
+	operator std::shared_ptr<V>() const { return strong ? strong : weak.lock(); }
 };
 
+template <typename T, typename = typename std::enable_if<!is_event_ptr<typename std::decay<T>::type>::value>::type>
+inline T &&bind_arg(const event *, T &&arg) { return std::forward<T>(arg); }
+
+template <typename U>
+inline bound_event<U> bind_arg(const event *self, const std::shared_ptr<U> &ev) { return bound_event<U>(self, ev); }
+
 class event_base
 {
   private:
@@ -38,20 +76,33 @@ class event_base
 
 	std::vector<std::queue<std::shared_ptr<event>>> activeQueues;
 	std::list<std::shared_ptr<signal_event>> signalList;
-	std::set<std::shared_ptr<time_event>, cmp_timeev> timeSet;
-	std::map<int, std::shared_ptr<Callback>> callbackMap;
+	std::unique_ptr<timer_queue> timers;
+
+	/* the clock of the timeouts, read once per loop iteration */
+	clockid_t _clock = CLOCK_MONOTONIC;
+	struct timeval _now = {0, 0};
+	bool _now_cached = false;
+
+	size_t _ntimer_ops = 0; /* pushes and erases of time_event */
+
+	/*
+	 * signals are read from a signalfd of this base, an rw_event like any
+	 * other. they are blocked once in the thread running the loop, the
+	 * handler they share with other bases is global.
+	 */
+	std::shared_ptr<rw_event> _sigfd_ev;
+	pthread_t _sig_thread;
+	sigset_t _sig_blockset;    /* what _sig_thread blocks for this base */
+	bool _sig_blocked = false; /* evsigmask is blocked in _sig_thread */
+	bool _looping = false;     /* loop() runs in this thread */
 
   protected:
-	std::map<int, std::shared_ptr<rw_event>> fdMapRw;
+	std::vector<std::shared_ptr<rw_event>> fdTableRw; /* indexed by fd, grows on demand */
+	int _nrw = 0; /* rw_event in fdTableRw */
 
   public:
 	sigset_t evsigmask;
 
-	static std::vector<int> sigcaught;
-	static volatile sig_atomic_t caught;
-	static std::pair<int, int> signal_pair;
-	static int needrecalc;
-
 	int _fds = 0; /* highest fd of added rw_event */
 	int _fdsz = 0;
 
@@ -64,6 +115,8 @@ class event_base
 
 	virtual int add(std::shared_ptr<rw_event>) { return 0; }
 	virtual int del(std::shared_ptr<rw_event>) { return 0; }
+	virtual int release(std::shared_ptr<rw_event>) { return 0; } /* rw_event goes away, drop what the backend keeps */
+	virtual bool is_edge_triggered() const { return false; }
 	virtual int recalc() = 0;
 	virtual int dispatch(struct timeval *) { return 0; }
 
@@ -75,19 +128,50 @@ class event_base
 			ret += aq.size();
 		return ret;
 	}
-	inline int rw_event_size() { return fdMapRw.size(); }
+	inline int rw_event_size() { return _nrw; }
+	inline size_t timer_ops() const { return _ntimer_ops; }
 
 	int priority_init(int npriorities);
+	int set_timer_backend(timer_backend backend);
+
+	/*
+	 * the monotonic time the timeouts count from. inside callbacks it is
+	 * the time the loop woke up at, outside of the loop it is read anew.
+	 */
+	inline const struct timeval &now()
+	{
+		if (!_now_cached)
+			__read_clock();
+		return _now;
+	}
+	/* reads the clock for a callback that has run long, the rest of the iteration gets this time */
+	inline void update_time()
+	{
+		__read_clock();
+		_now_cached = true;
+	}
+	/* CLOCK_MONOTONIC_COARSE, cheaper to read at the resolution of a tick */
+	inline void set_coarse_clock(bool on) { _clock = on ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC; }
 
 	int add_event(const std::shared_ptr<event> &ev);
 	int remove_event(const std::shared_ptr<event> &ev);
+
+	/* typed paths, the generic versions above forward to them by kind */
+	int add_event(const std::shared_ptr<rw_event> &ev);
+	int add_event(const std::shared_ptr<time_event> &ev);
+	int add_event(const std::shared_ptr<signal_event> &ev);
+	int remove_event(const std::shared_ptr<rw_event> &ev);
+	int remove_event(const std::shared_ptr<time_event> &ev);
+	int remove_event(const std::shared_ptr<signal_event> &ev);
 	void clean_rw_event(const std::shared_ptr<rw_event> &ev);
 
+	/* e itself among the arguments is held weakly, see bound_event */
 	template <typename E, typename F, typename... Rest>
 	void register_callback(E &&e, F &&f, Rest &&... rest)
 	{
-		auto tsk = std::bind(std::forward<F>(f), std::forward<Rest>(rest)...);
-		callbackMap[e->id] = std::make_shared<Callback>([tsk]() { tsk(); });
+		const event *self = &*e;
+		(void)self; // unused when there are no arguments
+		e->callback.emplace(std::bind(std::forward<F>(f), bind_arg(self, std::forward<Rest>(rest))...));
 	}
 
 	void activate(std::shared_ptr<event> ev, short ncalls);
@@ -106,6 +190,7 @@ class event_base
 		set_loop_nonblock_and_once();
 		__loop();
 		clear_loop_flags();
+		_now_cached = false;
 	}
 
 	inline void set_loop_nonblock() { _loop_nonblock = true; }
@@ -118,12 +203,19 @@ class event_base
 	inline void clear_loop_flags() { _loop_nonblock = _loop_once = false; }
 
   protected:
+	/* the rw_event added on fd, nullptr if none */
+	inline rw_event *fd_event(int fd) const
+	{
+		return fd >= 0 && fd < static_cast<int>(fdTableRw.size()) ? fdTableRw[fd].get() : nullptr;
+	}
+
 	void evsignal_process();
 	int evsignal_recalc();
-	int evsignal_deliver();
 
   private:
-	static void handler(int sig);
+	int __signalfd_update();
+	void __signal_release(int sig);
+	void __read_clock();
 	int __loop();
 	void __clean_up();
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace eve
+{
+
+/** class event_callback **
+ * 	type-erased void() callable stored inside the event itself.
+ * 	callables up to INLINE_SIZE bytes (a function pointer and a few bound
+ * 	arguments) live in the small buffer, bigger ones fall back to the heap.
+ * 	dispatching is a single indirect call. **/
+class event_callback
+{
+  public:
+	static const size_t INLINE_SIZE = 6 * sizeof(void *);
+
+  private:
+	using storage_t = std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type;
+
+	storage_t _buf;
+	void *_obj = nullptr;
+	void (*_invoke)(void *) = nullptr;
+	void (*_destroy)(void *) = nullptr;
+
+	template <typename T>
+	struct ops
+	{
+		static void invoke(void *p) { (*static_cast<T *>(p))(); }
+		static void destroy_inline(void *p) { static_cast<T *>(p)->~T(); }
+		static void destroy_heap(void *p) { delete static_cast<T *>(p); }
+	};
+
+  public:
+	event_callback() {}
+	~event_callback() { reset(); }
+
+	event_callback(const event_callback &) = delete;
+	event_callback &operator=(const event_callback &) = delete;
+
+	/* must not be called from inside the callback it replaces */
+	template <typename F>
+	void emplace(F &&f)
+	{
+		using T = typename std::decay<F>::type;
+		reset();
+		__emplace<T>(std::forward<F>(f),
+					 std::integral_constant<bool, sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(storage_t)>());
+		_invoke = &ops<T>::invoke;
+	}
+
+	void reset()
+	{
+		if (!_obj)
+			return;
+		void *obj = _obj;
+		auto destroy = _destroy;
+		_obj = nullptr;
+		_invoke = nullptr;
+		_destroy = nullptr;
+		destroy(obj);
+	}
+
+	inline explicit operator bool() const { return _obj != nullptr; }
+	inline void operator()() { _invoke(_obj); }
+
+  private:
+	template <typename T, typename F>
+	void __emplace(F &&f, std::true_type)
+	{
+		_obj = new (&_buf) T(std::forward<F>(f));
+		_destroy = &ops<T>::destroy_inline;
+	}
+
+	template <typename T, typename F>
+	void __emplace(F &&f, std::false_type)
+	{
+		_obj = new T(std::forward<F>(f));
+		_destroy = &ops<T>::destroy_heap;
+	}
+};
+
+} // namespace eve
@@ -0,0 +1,324 @@
+#include <io_uring_base.hh>
+#include <rw_event.hh>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace eve
+{
+
+static const uint64_t CANCEL_DATA = ~(uint64_t)0; /* completion of a poll remove, nothing to do */
+
+static inline uint64_t poll_data(int fd, unsigned gen)
+{
+	return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+io_uring_base::io_uring_base(unsigned entries)
+{
+	struct io_uring_params p;
+	std::memset(&p, 0, sizeof(p));
+
+	if ((_ringfd = syscall(__NR_io_uring_setup, entries, &p)) == -1)
+	{
+		LOG_ERROR << "io_uring_setup error with errno=" << errno;
+		return;
+	}
+	if (!(p.features & IORING_FEAT_EXT_ARG))
+		LOG_ERROR << "io_uring without IORING_FEAT_EXT_ARG, dispatch can not time out";
+
+	_sq_entries = p.sq_entries;
+	_sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	_cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		_sq_ring_sz = _cq_ring_sz = std::max(_sq_ring_sz, _cq_ring_sz);
+
+	_sq_ring = mmap(nullptr, _sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQ_RING);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		_cq_ring = _sq_ring;
+	else
+		_cq_ring = mmap(nullptr, _cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_CQ_RING);
+	_sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	_sqes = static_cast<struct io_uring_sqe *>(mmap(nullptr, _sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQES));
+
+	if (_sq_ring == MAP_FAILED || _cq_ring == MAP_FAILED || _sqes == MAP_FAILED)
+	{
+		LOG_ERROR << "io_uring mmap error with errno=" << errno;
+		return;
+	}
+
+	char *sq = static_cast<char *>(_sq_ring);
+	_sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+	_sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+	_sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+	_sq_local_tail = *_sq_tail;
+
+	/* sqes are always taken in ring order, the index array never changes */
+	unsigned *array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+	for (unsigned i = 0; i < p.sq_entries; i++)
+		array[i] = i;
+
+	char *cq = static_cast<char *>(_cq_ring);
+	_cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+	_cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+	_cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+}
+
+io_uring_base::~io_uring_base()
+{
+	if (_sqes && _sqes != MAP_FAILED)
+		munmap(_sqes, _sqes_sz);
+	if (_cq_ring && _cq_ring != MAP_FAILED && _cq_ring != _sq_ring)
+		munmap(_cq_ring, _cq_ring_sz);
+	if (_sq_ring && _sq_ring != MAP_FAILED)
+		munmap(_sq_ring, _sq_ring_sz);
+	if (_ringfd != -1)
+		close(_ringfd); // cancels every poll request left
+}
+
+int io_uring_base::recalc()
+{
+	return evsignal_recalc();
+}
+
+int io_uring_base::dispatch(struct timeval *tv)
+{
+	if (__flush_changes() == -1)
+		return -1;
+
+	bool nowait = tv && !timerisset(tv);
+	bool submit = _sq_local_tail != __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+	int res = 0;
+	if (!nowait) // submit the changes and wait in the same call
+	{
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+		std::memset(&arg, 0, sizeof(arg));
+		unsigned flags = IORING_ENTER_GETEVENTS;
+		if (tv)
+		{
+			ts.tv_sec = tv->tv_sec;
+			ts.tv_nsec = tv->tv_usec * 1000;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+			flags |= IORING_ENTER_EXT_ARG;
+		}
+		res = __enter(1, flags, tv ? &arg : nullptr, tv ? sizeof(arg) : 0);
+	}
+	else if (submit) // the completions ready so far are in the ring already
+		res = __enter(0, 0, nullptr, 0);
+
+	if (res == -1 && errno != EINTR && errno != ETIME && errno != EBUSY)
+	{
+		LOG_ERROR << "io_uring_enter error with errno=" << errno;
+		return -1;
+	}
+
+	__reap();
+	return 0;
+}
+
+int io_uring_base::add(std::shared_ptr<rw_event> ev)
+{
+	__mark(ev->fd);
+	return 0;
+}
+
+int io_uring_base::del(std::shared_ptr<rw_event> ev)
+{
+	__mark(ev->fd);
+	return 0;
+}
+
+int io_uring_base::release(std::shared_ptr<rw_event> ev)
+{
+	/* the poll request keeps the file open, the cancel has to reach the kernel before close */
+	int res = 0;
+	if (ev->uring_fd == ev->fd && ev->fd >= 0 && _states[ev->fd].owner == ev.get() && _states[ev->fd].armed)
+	{
+		res = __cancel(ev->fd);
+		if (res == 0 && __enter(0, 0, nullptr, 0) == -1 && errno != EBUSY)
+			res = -1;
+	}
+	ev->uring_fd = -1;
+	return res;
+}
+
+/** private function **/
+
+void io_uring_base::__mark(int fd)
+{
+	if (fd < 0)
+		return;
+	if (fd >= static_cast<int>(_states.size()))
+		_states.resize(std::max<size_t>(fd + 1, _states.size() * 2));
+	if (_states[fd].dirty)
+		return;
+	_states[fd].dirty = true;
+	_changes.push_back(fd);
+}
+
+int io_uring_base::__flush_changes()
+{
+	int res = 0;
+	for (size_t i = 0; i < _changes.size(); i++)
+		if (__update(_changes[i]) == -1)
+			res = -1;
+	_changes.clear();
+	return res;
+}
+
+/* bring the poll request of fd in line with the interest of its rw_event */
+int io_uring_base::__update(int fd)
+{
+	fd_state &s = _states[fd];
+	s.dirty = false;
+
+	rw_event *ev = fd_event(fd);
+	short want = 0;
+	if (ev && !ev->alive)
+		ev = nullptr;
+	if (ev)
+	{
+		if (ev->is_readable())
+			want |= POLLIN;
+		if (ev->is_writeable())
+			want |= POLLOUT;
+	}
+
+	/* a request made for another rw_event or an fd set since then watches the wrong file */
+	bool stale = ev && (s.owner != ev || ev->uring_fd != fd);
+	if (!stale && s.armed == want)
+		return 0;
+
+	if (__cancel(fd) == -1)
+		return -1;
+	s.owner = ev;
+	if (ev)
+		ev->uring_fd = fd;
+
+	if (want)
+	{
+		struct io_uring_sqe *sqe;
+		if ((sqe = __get_sqe()) == nullptr)
+			return -1;
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = fd;
+		sqe->poll32_events = want;
+		sqe->user_data = poll_data(fd, s.gen);
+		s.armed = want;
+	}
+	return 0;
+}
+
+/* queues the removal of the poll request of fd, its completion is dropped from now on */
+int io_uring_base::__cancel(int fd)
+{
+	fd_state &s = _states[fd];
+	if (s.armed)
+	{
+		struct io_uring_sqe *sqe;
+		if ((sqe = __get_sqe()) == nullptr)
+			return -1;
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = poll_data(fd, s.gen);
+		sqe->user_data = CANCEL_DATA;
+	}
+	s.gen++;
+	s.armed = 0;
+	s.owner = nullptr;
+	return 0;
+}
+
+struct io_uring_sqe *io_uring_base::__get_sqe()
+{
+	if (_ringfd == -1)
+		return nullptr;
+
+	/* ring full, hand what is queued to the kernel first */
+	if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries)
+	{
+		if (__enter(0, 0, nullptr, 0) == -1 && errno != EBUSY)
+		{
+			LOG_ERROR << "io_uring_enter error with errno=" << errno;
+			return nullptr;
+		}
+		if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries)
+			return nullptr;
+	}
+
+	struct io_uring_sqe *sqe = &_sqes[_sq_local_tail & _sq_mask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	_sq_local_tail++;
+	_nsqe++;
+	return sqe;
+}
+
+int io_uring_base::__enter(unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+	__atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+	unsigned to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+	_nenter++;
+	return syscall(__NR_io_uring_enter, _ringfd, to_submit, min_complete, flags, arg, argsz);
+}
+
+void io_uring_base::__reap()
+{
+	if (_ringfd == -1)
+		return;
+
+	unsigned head = *_cq_head;
+	unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const struct io_uring_cqe *cqe = &_cqes[head & _cq_mask];
+		uint64_t data = cqe->user_data;
+		int res = cqe->res;
+		if (data == CANCEL_DATA)
+			continue;
+
+		int fd = static_cast<int>(data & 0xffffffff);
+		unsigned gen = static_cast<unsigned>(data >> 32);
+		if (fd >= static_cast<int>(_states.size()) || _states[fd].gen != gen || !_states[fd].armed)
+			continue; // cancelled or replaced in the meantime
+		_states[fd].armed = 0;
+		__activate(fd, res);
+	}
+	__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+void io_uring_base::__activate(int fd, int res)
+{
+	/* the request is used up, re-arm whatever interest is left after the callbacks */
+	__mark(fd);
+
+	if (!fd_event(fd) || fd_event(fd) != _states[fd].owner)
+		return;
+	auto ev = fdTableRw[fd];
+
+	int what = res < 0 ? (POLLIN | POLLOUT) : res;
+	if (what & (POLLHUP | POLLERR))
+		what |= (POLLIN | POLLOUT);
+
+	ev->clear_active();
+	if ((what & POLLIN) && ev->is_readable())
+		ev->set_active_read();
+	if ((what & POLLOUT) && ev->is_writeable())
+		ev->set_active_write();
+
+	if (ev->is_read_active() || ev->is_write_active())
+	{
+		if (!ev->is_persistent())
+			remove_event(ev);
+		activate(ev, 1);
+	}
+}
+
+} // namespace eve
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "event_base.hh"
+
+#include <linux/io_uring.h>
+
+#include <vector>
+
+namespace eve
+{
+
+class rw_event;
+
+/** class io_uring_base **
+ * 	readiness through one-shot io_uring poll requests. add() and del()
+ * 	only mark the fd, the poll requests they amount to are queued on the
+ * 	submission ring and handed to the kernel together with the wait, in a
+ * 	single io_uring_enter per dispatch. a persistent event is re-armed the
+ * 	same way after each completion, so the semantics stay level-triggered.
+ * 	only readiness goes through the ring, reads, writes and accepts are
+ * 	still syscalls of their own, so it makes no fewer than epoll. needs
+ * 	linux 5.11 (IORING_FEAT_EXT_ARG) for the wait timeout. **/
+class io_uring_base : public event_base
+{
+private:
+  struct fd_state
+  {
+    unsigned gen = 0;          /* tags the poll request of the fd, stale completions are dropped */
+    short armed = 0;           /* POLLIN/POLLOUT of the request in flight */
+    bool dirty = false;        /* queued in _changes */
+    rw_event *owner = nullptr; /* the rw_event the request was made for */
+  };
+
+  int _ringfd = -1;
+  unsigned _sq_entries = 0;
+
+  void *_sq_ring = nullptr;
+  void *_cq_ring = nullptr;
+  size_t _sq_ring_sz = 0;
+  size_t _cq_ring_sz = 0;
+  struct io_uring_sqe *_sqes = nullptr;
+  size_t _sqes_sz = 0;
+
+  unsigned *_sq_head = nullptr;
+  unsigned *_sq_tail = nullptr;
+  unsigned _sq_mask = 0;
+  unsigned _sq_local_tail = 0; /* sqes filled but not yet published */
+  unsigned *_cq_head = nullptr;
+  unsigned *_cq_tail = nullptr;
+  unsigned _cq_mask = 0;
+  struct io_uring_cqe *_cqes = nullptr;
+
+  std::vector<fd_state> _states; /* indexed by fd */
+  std::vector<int> _changes;     /* fds whose poll request has to be updated */
+
+  size_t _nenter = 0; /* io_uring_enter calls */
+  size_t _nsqe = 0;   /* submitted poll and cancel requests */
+
+public:
+  io_uring_base(unsigned entries = 1024);
+  ~io_uring_base();
+
+  int add(std::shared_ptr<rw_event> ev);
+  int del(std::shared_ptr<rw_event> ev);
+  int release(std::shared_ptr<rw_event> ev);
+  int dispatch(struct timeval *tv);
+  int recalc();
+
+  inline size_t enter_count() const { return _nenter; }
+  inline size_t sqe_count() const { return _nsqe; }
+
+private:
+  void __mark(int fd);
+  int __flush_changes();
+  int __update(int fd);
+  int __cancel(int fd);
+  struct io_uring_sqe *__get_sqe();
+  int __enter(unsigned min_complete, unsigned flags, void *arg, size_t argsz);
+  void __reap();
+  void __activate(int fd, int res);
+};
+
+} // namespace eve
@@ -23,7 +23,7 @@ void poll_base::poll_check()
         struct pollfd *pfd = kv.second;
         assert(pfd);
         assert(fd == pfd->fd);
-        auto ev = fdMapRw[fd];
+        auto ev = fd_event(fd);
         assert(ev);
         assert(fd == ev->fd);
         if (ev->is_readable())
@@ -35,9 +35,6 @@ void poll_base::poll_check()
 
 int poll_base::dispatch(struct timeval *tv)
 {
-    if (evsignal_deliver() == -1)
-        return -1;
-
     int sec = -1;
     if (tv)
         sec = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
@@ -51,9 +48,6 @@ int poll_base::dispatch(struct timeval *tv)
         fds[i++] = *kv.second;
 
     int res = poll(fds, nfds, sec);
-    if (evsignal_recalc() == -1)
-        return -1;
-
     if (res == -1)
     {
         if (errno != EINTR)
@@ -61,11 +55,8 @@ int poll_base::dispatch(struct timeval *tv)
             LOG_ERROR << "poll\n";
             return -1;
         }
-        evsignal_process();
         return 0;
     }
-    else if (caught)
-        evsignal_process();
 
     if (res == 0)
         return 0;
@@ -74,9 +65,9 @@ int poll_base::dispatch(struct timeval *tv)
     for (i = 0; i < nfds; i++)
     {
         what = fds[i].revents;
-        auto ev = fdMapRw.at(fds[i].fd);
-        if (what && ev)
+        if (what && fd_event(fds[i].fd))
         {
+            auto ev = fdTableRw[fds[i].fd];
             ev->clear_active();
             /* if the file gets closed notify */
             if (what & (POLLHUP | POLLERR))
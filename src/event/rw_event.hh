@@ -28,22 +28,40 @@ class rw_event : public event
 	void *rdata;
 	void *wdata;
 
-	bool epoll_in = false;
+	bool epoll_in = false;	/* registered with the kernel */
 	bool epoll_out = false;
 
+	/* level-triggered epoll, the interest to register before the next wait */
+	bool change_in = false;
+	bool change_out = false;
+	bool epoll_changed = false;
+
+	/* edge-triggered epoll, the fd is registered once and readiness is cached here */
+	int epoll_fd = -1;
+	bool read_ready = false;
+	bool write_ready = false;
+	bool epoll_pending = false;
+
+	int uring_fd = -1; /* io_uring_base, the fd its poll request was made for */
+
 	int timeout = -1;
 
   public:
-	rw_event() {}
-	rw_event(std::shared_ptr<event_base> base) : event(base) {}
-	rw_event(std::shared_ptr<event_base> base, int fd, TYPE t) : event(base), fd(fd) { set_type(t); }
+	rw_event() : event(K_RW) {}
+	rw_event(std::shared_ptr<event_base> base) : event(base, K_RW) {}
+	rw_event(std::shared_ptr<event_base> base, int fd, TYPE t) : event(base, K_RW), fd(fd) { set_type(t); }
 	~rw_event()
 	{
 		if (fd != -1)
 			closefd(fd);
 	}
 
-	inline void set_fd(int fd) { this->fd = fd; }
+	inline void set_fd(int fd)
+	{
+		this->fd = fd;
+		epoll_fd = uring_fd = -1;
+		read_ready = write_ready = false;
+	}
 	inline void set_timeout(int sec) { this->timeout = sec; }
 
 	inline void enable_read() { _read = true; }
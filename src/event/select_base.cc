@@ -35,29 +35,27 @@ void select_base::check_fdset()
     LOG_DEBUG;
     bool iread = false, iwrite = false;
 
-    for (auto kv : fdMapRw)
+    for (int fd = 0; fd < static_cast<int>(fdTableRw.size()); fd++)
     {
-        // std::cout << "kv:" << kv.first << " " << kv.second << std::endl;
+        rw_event *ev = fdTableRw[fd].get();
+        if (!ev)
+            continue;
         iread = false, iwrite = false;
-        if (FD_ISSET(kv.first, event_readset_in))
+        if (FD_ISSET(fd, event_readset_in))
             iread = true;
-        if (FD_ISSET(kv.first, event_writeset_in))
+        if (FD_ISSET(fd, event_writeset_in))
             iwrite = true;
 
         if (!iread && !iwrite)
         {
-            assert(!kv.second);
+            assert(!ev);
             continue;
         }
-        else
-        {
-            assert(kv.second);
-            // assert(kv.second->_fd == kv.first);
-        }
+        // assert(ev->fd == fd);
         if (iread)
-            assert(kv.second->is_readable());
+            assert(ev->is_readable());
         if (iwrite)
-            assert(kv.second->is_writeable());
+            assert(ev->is_writeable());
     }
 }
 
@@ -74,16 +72,10 @@ int select_base::dispatch(struct timeval *tv)
 
     check_fdset();
 
-    if (evsignal_deliver() == -1)
-        return -1;
-
     int res = select(_fds + 1, event_readset_out, event_writeset_out, nullptr, tv);
 
     // check_fdset();
 
-    if (evsignal_recalc() == -1)
-        return -1;
-
     if (res == -1)
     {
         if (errno != EINTR)
@@ -91,27 +83,23 @@ int select_base::dispatch(struct timeval *tv)
             LOG_ERROR << "select error errno=" << errno;
             return -1;
         }
-        evsignal_process();
         return 0;
     }
-    else if (caught)
-    {
-        evsignal_process();
-    }
 
     // check_fdset();
     bool iread, iwrite;
-    for (auto kv : fdMapRw)
+    int nfds = std::min(_fds + 1, static_cast<int>(fdTableRw.size()));
+    for (int fd = 0; fd < nfds; fd++)
     {
         iread = iwrite = false;
-        if (FD_ISSET(kv.first, event_readset_out))
+        if (FD_ISSET(fd, event_readset_out))
             iread = true;
-        if (FD_ISSET(kv.first, event_writeset_out))
+        if (FD_ISSET(fd, event_writeset_out))
             iwrite = true;
 
-        if ((iread || iwrite) && kv.second)
+        if ((iread || iwrite) && fdTableRw[fd])
         {
-            auto ev = kv.second;
+            auto ev = fdTableRw[fd];
             ev->clear_active();
             if (iread && ev->is_readable())
                 ev->set_active_read();
@@ -8,8 +8,8 @@ public:
 	int sig = -1;
 
 public:
-	signal_event(std::shared_ptr<event_base> base) : event(base) {}
-	signal_event(std::shared_ptr<event_base> base, int sig) : event(base), sig(sig) {}
+	signal_event(std::shared_ptr<event_base> base) : event(base, K_SIGNAL) {}
+	signal_event(std::shared_ptr<event_base> base, int sig) : event(base, K_SIGNAL), sig(sig) {}
 	~signal_event() {}
 
 	inline void set_sig(int sig) { this->sig = sig; }
@@ -1,30 +1,50 @@
 #pragma once
 
 #include <event.hh>
+#include <event_base.hh>
+
+#include <cstdint>
 
 namespace eve
 {
 
 class time_event : public event
 {
+	friend class timer_wheel;
+	friend class timer_set;
+	friend struct cmp_timeev;
 
 public:
 	struct timeval timeout;
 
+private:
+	/* intrusive links of timer_wheel */
+	time_event *_wheel_prev = nullptr;
+	time_event *_wheel_next = nullptr;
+	time_event **_wheel_slot = nullptr;
+	uint64_t _wheel_expires = 0;
+	std::shared_ptr<time_event> _wheel_self = nullptr; /* keeps the event alive while queued */
+
+	/* the timeout timer_set ordered the event by, set_timer() does not move it */
+	struct timeval _set_timeout = {0, 0};
+	bool _set_queued = false;
+
 public:
-	time_event(std::shared_ptr<event_base> base) : event(base) { timerclear(&timeout); }
+	time_event(std::shared_ptr<event_base> base) : event(base, K_TIME) { timerclear(&timeout); }
 	~time_event() {}
 
+	/* from the time of the loop, see event_base::now() */
 	void set_timer(int sec, int usec)
 	{
-		struct timeval now, tv;
-		gettimeofday(&now, nullptr);
+		auto b = get_base();
+		if (!b)
+			return;
 
-		timerclear(&tv);
+		struct timeval tv;
 		tv.tv_sec = sec;
 		tv.tv_usec = usec;
 
-		timeradd(&now, &tv, &timeout);
+		timeradd(&b->now(), &tv, &timeout);
 	}
 };
 
@@ -0,0 +1,61 @@
+#include <timer_queue.hh>
+#include <time_event.hh>
+
+namespace eve
+{
+
+bool cmp_timeev::operator()(std::shared_ptr<time_event> const &lhs, std::shared_ptr<time_event> const &rhs) const
+{
+	/* timers armed within the same microsecond are still distinct */
+	if (timercmp(&lhs->_set_timeout, &rhs->_set_timeout, !=))
+		return timercmp(&lhs->_set_timeout, &rhs->_set_timeout, <);
+	return lhs.get() < rhs.get();
+}
+
+void timer_set::push(const std::shared_ptr<time_event> &ev, const struct timeval &)
+{
+	if (ev->_set_queued) // already queued, re-arm at its new timeout
+		timeSet.erase(ev);
+	ev->_set_timeout = ev->timeout;
+	ev->_set_queued = true;
+	timeSet.insert(ev);
+}
+
+void timer_set::erase(const std::shared_ptr<time_event> &ev)
+{
+	if (!ev->_set_queued)
+		return;
+	timeSet.erase(ev);
+	ev->_set_queued = false;
+}
+
+void timer_set::clear()
+{
+	for (const auto &ev : timeSet)
+		ev->_set_queued = false;
+	timeSet.clear();
+}
+
+bool timer_set::next_timeout(struct timeval *tv)
+{
+	if (timeSet.empty())
+		return false;
+	*tv = (*timeSet.begin())->_set_timeout;
+	return true;
+}
+
+std::shared_ptr<time_event> timer_set::pop_expired(const struct timeval &now)
+{
+	if (timeSet.empty())
+		return nullptr;
+
+	auto i = timeSet.begin();
+	auto ev = *i;
+	if (timercmp(&ev->_set_timeout, &now, >))
+		return nullptr;
+	timeSet.erase(i);
+	ev->_set_queued = false;
+	return ev;
+}
+
+} // namespace eve
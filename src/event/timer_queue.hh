@@ -0,0 +1,62 @@
+#pragma once
+
+#include <sys/time.h>
+
+#include <set>
+#include <memory>
+
+namespace eve
+{
+class time_event;
+
+enum timer_backend
+{
+	TIMER_SET = 0, /* red-black tree ordered by timeout */
+	TIMER_WHEEL,   /* hierarchical timing wheel, O(1) insert/cancel */
+};
+
+/** class timer_queue **
+ * 	pending time_events of an event_base, ordered by their timeout **/
+class timer_queue
+{
+  public:
+	virtual ~timer_queue() {}
+
+	/* insert ev, or re-arm it if it is already queued. now is the time of the base */
+	virtual void push(const std::shared_ptr<time_event> &ev, const struct timeval &now) = 0;
+	virtual void erase(const std::shared_ptr<time_event> &ev) = 0;
+	virtual void clear() = 0;
+
+	virtual bool empty() const = 0;
+	virtual size_t size() const = 0;
+
+	/* the earliest timeout in queue, return false if empty */
+	virtual bool next_timeout(struct timeval *tv) = 0;
+
+	/* remove and return one event timed out at now, nullptr if none */
+	virtual std::shared_ptr<time_event> pop_expired(const struct timeval &now) = 0;
+};
+
+struct cmp_timeev
+{
+	bool operator()(std::shared_ptr<time_event> const &lhs, std::shared_ptr<time_event> const &rhs) const;
+};
+
+class timer_set : public timer_queue
+{
+  private:
+	std::set<std::shared_ptr<time_event>, cmp_timeev> timeSet;
+
+  public:
+	void push(const std::shared_ptr<time_event> &ev, const struct timeval &) override;
+	void erase(const std::shared_ptr<time_event> &ev) override;
+	void clear() override;
+
+	bool empty() const override { return timeSet.empty(); }
+	size_t size() const override { return timeSet.size(); }
+
+	bool next_timeout(struct timeval *tv) override;
+	std::shared_ptr<time_event> pop_expired(const struct timeval &now) override;
+};
+
+} // namespace eve
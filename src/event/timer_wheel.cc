@@ -0,0 +1,289 @@
+#include <timer_wheel.hh>
+#include <time_event.hh>
+
+#include <cstring>
+#include <vector>
+
+namespace eve
+{
+
+static inline uint64_t to_tick(const struct timeval &tv)
+{
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+timer_wheel::timer_wheel()
+{
+	std::memset(_root, 0, sizeof(_root));
+	std::memset(_levels, 0, sizeof(_levels));
+}
+
+void timer_wheel::push(const std::shared_ptr<time_event> &ev, const struct timeval &now)
+{
+	time_event *e = ev.get();
+	if (e->_wheel_slot) // already queued, just re-arm
+		__unlink(e);
+	else
+	{
+		e->_wheel_self = ev;
+		_size++;
+	}
+	e->_wheel_expires = to_tick(e->timeout);
+
+	/* nothing else is on the wheel, it stopped turning and goes on from the current tick */
+	uint64_t tick = to_tick(now);
+	if (_size == _nexpired + 1 && _jiffies < tick)
+		_jiffies = tick;
+	__place(e);
+}
+
+void timer_wheel::erase(const std::shared_ptr<time_event> &ev)
+{
+	time_event *e = ev.get();
+	if (!e->_wheel_slot)
+		return;
+	__unlink(e);
+	_size--;
+	e->_wheel_self = nullptr;
+}
+
+void timer_wheel::clear()
+{
+	std::vector<std::shared_ptr<time_event>> queued;
+	queued.reserve(_size);
+
+	auto release = [&queued](time_event **slot) {
+		time_event *ev = *slot;
+		*slot = nullptr;
+		while (ev)
+		{
+			time_event *next = ev->_wheel_next;
+			ev->_wheel_prev = ev->_wheel_next = nullptr;
+			ev->_wheel_slot = nullptr;
+			queued.push_back(std::move(ev->_wheel_self));
+			ev = next;
+		}
+	};
+
+	for (int i = 0; i < ROOT_SIZE; i++)
+		release(&_root[i]);
+	for (int l = 0; l < NLEVELS; l++)
+		for (int i = 0; i < LEVEL_SIZE; i++)
+			release(&_levels[l][i]);
+	release(&_expired);
+
+	_expired_tail = nullptr;
+	_size = _nexpired = 0;
+	/* the events may only be destroyed after the wheel is consistent again */
+	queued.clear();
+}
+
+bool timer_wheel::next_timeout(struct timeval *tv)
+{
+	if (_size == 0)
+		return false;
+
+	if (_expired)
+	{
+		timerclear(tv);
+		return true;
+	}
+
+	uint64_t next = UINT64_MAX;
+	time_event *first = nullptr;
+
+	/* the root wheel holds exactly the ticks [_jiffies, _jiffies + ROOT_SIZE) */
+	uint64_t idx = _jiffies & ROOT_MASK;
+	for (uint64_t i = 0; i < ROOT_SIZE; i++)
+	{
+		if ((first = _root[(idx + i) & ROOT_MASK]) != nullptr)
+		{
+			next = _jiffies + i;
+			break;
+		}
+	}
+
+	/* an outer slot has to be woken up for when it gets cascaded */
+	int shift = ROOT_BITS;
+	for (int l = 0; l < NLEVELS; l++, shift += LEVEL_BITS)
+	{
+		uint64_t unit = (uint64_t)1 << shift;
+		uint64_t t = (_jiffies + unit - 1) & ~(unit - 1);
+		for (int k = 0; k < LEVEL_SIZE && t < next; k++, t += unit)
+		{
+			if (_levels[l][(t >> shift) & LEVEL_MASK])
+			{
+				next = t;
+				first = nullptr;
+				break;
+			}
+		}
+	}
+
+	if (next == UINT64_MAX)
+		return false;
+
+	if (first) // a root slot shares one tick, the exact timeout is the smallest of them
+	{
+		*tv = first->timeout;
+		for (auto ev = first->_wheel_next; ev; ev = ev->_wheel_next)
+			if (timercmp(&ev->timeout, tv, <))
+				*tv = ev->timeout;
+	}
+	else
+	{
+		tv->tv_sec = next / 1000;
+		tv->tv_usec = (next % 1000) * 1000;
+	}
+	return true;
+}
+
+std::shared_ptr<time_event> timer_wheel::pop_expired(const struct timeval &now)
+{
+	if (!_expired)
+		__advance(now);
+
+	time_event *ev = _expired;
+	if (!ev)
+		return nullptr;
+
+	__unlink(ev);
+	_size--;
+	return std::move(ev->_wheel_self);
+}
+
+/** private function **/
+
+void timer_wheel::__place(time_event *ev)
+{
+	uint64_t expires = ev->_wheel_expires;
+	if (expires < _jiffies) // already timed out, fire with the current tick
+		expires = _jiffies;
+
+	uint64_t idx = expires - _jiffies;
+	if (idx >= MAX_SPAN) // too far away, park it in the last slot and cascade again later
+	{
+		idx = MAX_SPAN - 1;
+		expires = _jiffies + idx;
+	}
+
+	if (idx < ROOT_SIZE)
+	{
+		__link(&_root[expires & ROOT_MASK], ev);
+		return;
+	}
+
+	int level = 0, shift = ROOT_BITS;
+	while (idx >= ((uint64_t)1 << (shift + LEVEL_BITS)))
+	{
+		level++;
+		shift += LEVEL_BITS;
+	}
+	__link(&_levels[level][(expires >> shift) & LEVEL_MASK], ev);
+}
+
+void timer_wheel::__link(time_event **slot, time_event *ev)
+{
+	ev->_wheel_prev = nullptr;
+	ev->_wheel_next = *slot;
+	if (*slot)
+		(*slot)->_wheel_prev = ev;
+	*slot = ev;
+	ev->_wheel_slot = slot;
+}
+
+void timer_wheel::__unlink(time_event *ev)
+{
+	if (ev->_wheel_slot == &_expired)
+	{
+		if (_expired_tail == ev)
+			_expired_tail = ev->_wheel_prev;
+		_nexpired--;
+	}
+
+	if (ev->_wheel_prev)
+		ev->_wheel_prev->_wheel_next = ev->_wheel_next;
+	else
+		*ev->_wheel_slot = ev->_wheel_next;
+	if (ev->_wheel_next)
+		ev->_wheel_next->_wheel_prev = ev->_wheel_prev;
+
+	ev->_wheel_prev = ev->_wheel_next = nullptr;
+	ev->_wheel_slot = nullptr;
+}
+
+/* re-place every event of an outer slot relative to the current tick */
+void timer_wheel::__cascade(time_event **slot)
+{
+	time_event *ev = *slot;
+	*slot = nullptr;
+	while (ev)
+	{
+		time_event *next = ev->_wheel_next;
+		ev->_wheel_prev = ev->_wheel_next = nullptr;
+		ev->_wheel_slot = nullptr;
+		__place(ev);
+		ev = next;
+	}
+}
+
+/*
+ * move every event timed out at now to the expired list, the ticks before
+ * now are processed completely, the events of the current tick only when
+ * their exact timeout has been reached
+ */
+void timer_wheel::__advance(const struct timeval &now)
+{
+	uint64_t tick = to_tick(now);
+	while (true)
+	{
+		if (_size == _nexpired) // nothing left on the wheel, jump ahead
+		{
+			if (_jiffies < tick)
+				_jiffies = tick;
+			break;
+		}
+
+		uint64_t idx = _jiffies & ROOT_MASK;
+		if (idx == 0)
+		{
+			int shift = ROOT_BITS;
+			for (int l = 0; l < NLEVELS; l++, shift += LEVEL_BITS)
+			{
+				uint64_t slot = (_jiffies >> shift) & LEVEL_MASK;
+				__cascade(&_levels[l][slot]);
+				if (slot != 0)
+					break;
+			}
+		}
+
+		time_event *ev = _root[idx];
+		while (ev)
+		{
+			time_event *next = ev->_wheel_next;
+			if (_jiffies < tick || !timercmp(&ev->timeout, &now, >))
+				__expire(ev);
+			ev = next;
+		}
+
+		if (_jiffies >= tick) // the rest of this tick stays until its exact timeout
+			break;
+		_jiffies++;
+	}
+}
+
+void timer_wheel::__expire(time_event *ev)
+{
+	__unlink(ev);
+	ev->_wheel_next = nullptr;
+	ev->_wheel_prev = _expired_tail;
+	ev->_wheel_slot = &_expired;
+	if (_expired_tail)
+		_expired_tail->_wheel_next = ev;
+	else
+		_expired = ev;
+	_expired_tail = ev;
+	_nexpired++;
+}
+
+} // namespace eve
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <timer_queue.hh>
+
+#include <cstdint>
+
+namespace eve
+{
+
+/** class timer_wheel **
+ * 	hierarchical timing wheel with slots of 1 millisecond.
+ * 	the root wheel holds the timers of the next 256 ticks, every outer
+ * 	level covers 64 times the span of the level below and is cascaded
+ * 	down when the level below wraps around. insert, cancel and re-arm
+ * 	are O(1) and do not allocate, the links live in the time_event. **/
+class timer_wheel : public timer_queue
+{
+  private:
+	static const int ROOT_BITS = 8;
+	static const int LEVEL_BITS = 6;
+	static const int NLEVELS = 3; /* outer levels above the root wheel */
+	static const int ROOT_SIZE = 1 << ROOT_BITS;
+	static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+	static const uint64_t ROOT_MASK = ROOT_SIZE - 1;
+	static const uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+	static const uint64_t MAX_SPAN = (uint64_t)1 << (ROOT_BITS + NLEVELS * LEVEL_BITS);
+
+	time_event *_root[ROOT_SIZE];
+	time_event *_levels[NLEVELS][LEVEL_SIZE];
+
+	/* timed out events waiting to be popped, in expiration order */
+	time_event *_expired = nullptr;
+	time_event *_expired_tail = nullptr;
+
+	uint64_t _jiffies = 0; /* first tick not completely processed */
+	size_t _size = 0;
+	size_t _nexpired = 0;
+
+  public:
+	timer_wheel();
+	~timer_wheel() { clear(); }
+
+	void push(const std::shared_ptr<time_event> &ev, const struct timeval &now) override;
+	void erase(const std::shared_ptr<time_event> &ev) override;
+	void clear() override;
+
+	bool empty() const override { return _size == 0; }
+	size_t size() const override { return _size; }
+
+	bool next_timeout(struct timeval *tv) override;
+	std::shared_ptr<time_event> pop_expired(const struct timeval &now) override;
+
+  private:
+	void __place(time_event *ev);
+	void __link(time_event **slot, time_event *ev);
+	void __unlink(time_event *ev);
+	void __cascade(time_event **slot);
+	void __expire(time_event *ev);
+	void __advance(const struct timeval &now);
+};
+
+} // namespace eve
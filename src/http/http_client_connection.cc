@@ -7,23 +7,9 @@
 namespace eve
 {
 
-static void read_timeout_cb(http_client_connection *conn)
-{
-    LOG_WARN << "client connection read timeout";
-    conn->fail(HTTP_TIMEOUT);
-}
-
-static void write_timeout_cb(http_client_connection *conn)
-{
-    LOG_WARN << "client connection read timeout";
-    conn->fail(HTTP_TIMEOUT);
-}
-
 http_client_connection::http_client_connection(std::shared_ptr<event_base> base, int fd, std::shared_ptr<http_client> client)
     : http_connection(base, fd), client(client)
 {
-    base->register_callback(readTimer, read_timeout_cb, this);
-    base->register_callback(writeTimer, write_timeout_cb, this);
     this->timeout = client->timeout;
 }
 
@@ -56,8 +42,9 @@ void http_client_connection::do_read_done()
             start_write();
         else
         {
-            start_read();
+            /* the next response may be in the input already */
             requests.front()->kind = RESPONSE;
+            start_read();
         }
     }
 
@@ -3,6 +3,7 @@
 #include <util_network.hh>
 #include <util_linux.hh>
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <string>
@@ -17,13 +18,18 @@ http_connection::http_connection(std::shared_ptr<event_base> base, int fd)
 {
     this->state = DISCONNECTED;
 
+    /* headers and bodies are linked into the output and leave in one writev */
+    output = std::unique_ptr<buffer>(new buffer(BUFFER_CHAINED));
+
     register_readcb(handler_read, this);
     register_eofcb(handler_eof, this);
     register_writecb(handler_write, this);
     register_errorcb(handler_error, this);
+    set_read_watermark(0, HTTP_READ_HIGH_WATERMARK);
+    set_nosignal(true); // sockets only
 
-    readTimer = create_event<time_event>(base);
-    writeTimer = create_event<time_event>(base);
+    timer = create_event<time_event>(base);
+    base->register_callback(timer, handler_timeout, this);
 }
 
 http_connection::~http_connection()
@@ -38,24 +44,21 @@ http_connection::~http_connection()
 
     auto base = get_base();
     if (base)
-    {
-        base->remove_event(readTimer);
-        base->remove_event(writeTimer);
-    }
+        base->remove_event(timer);
 }
 
 void http_connection::close(int op)
 {
-    if (get_obuf_length() > 0 && op == 0)
+    if (has_pending_output() && op == 0)
     {
-        std::cout << "length=" << get_obuf_length() << ";";
+        std::cout << "length=" << get_obuf_length() + get_file_left() << ";";
         start_write();
         return;
     }
     LOG << "close connection with fd=" << fd();
-    get_base()->remove_event(readTimer);
-    get_base()->remove_event(writeTimer);
+    __cancel_timer();
     get_base()->clean_rw_event(ev);
+    clear_file();
     closefd(fd());
     set_fd(-1);
     state = CLOSED;
@@ -75,8 +78,22 @@ void http_connection::reset()
     //     close();
     // }
     state = DISCONNECTED;
+    corked = false;
+    read_timed = write_timed = false;
     input->reset();
     output->reset();
+    clear_file();
+}
+
+void http_connection::clear_requests()
+{
+    while (!requests.empty())
+    {
+        auto req = std::move(requests.front());
+        requests.pop();
+        req->reset();
+        emptyQueue.push(std::move(req));
+    }
 }
 
 void http_connection::start_read()
@@ -91,10 +108,24 @@ void http_connection::start_read()
 
 void http_connection::start_write()
 {
-    if (get_obuf_length() <= 0)
+    if (!has_pending_output() || corked)
+        return;
+    if (!is_reading()) // a server goes on reading pipelined requests
+        state = WRITING;
+    /* most responses fit into the socket buffer, the timer is for what does not */
+    flush();
+    if (has_pending_output())
+        add_write_timer();
+}
+
+void http_connection::resume_body(http_request *req)
+{
+    /* from inside chunk_cb read_body() goes on by itself */
+    if (in_chunk_cb || is_closed() || requests.empty() || reading_request() != req)
         return;
-    state = WRITING;
-    add_write_and_timer();
+    if (state != READING_BODY && state != READING_TRAILER)
+        return;
+    read_http();
 }
 
 void http_connection::add_read_and_timer()
@@ -102,40 +133,64 @@ void http_connection::add_read_and_timer()
     add_read_event();
     if (timeout > 0)
     {
-        readTimer->set_timer(timeout, 0);
-        get_base()->add_event(readTimer);
+        read_timed = true;
+        __touch_timer();
     }
 }
 
 void http_connection::add_write_and_timer()
 {
     add_write_event();
+    add_write_timer();
+}
+
+void http_connection::add_write_timer()
+{
     if (timeout > 0)
     {
-        writeTimer->set_timer(timeout, 0);
-        get_base()->add_event(writeTimer);
+        write_timed = true;
+        __touch_timer();
     }
 }
 
+/* the queued timer stays, handler_timeout() finds nothing waiting */
 void http_connection::remove_read_timer()
 {
-    get_base()->remove_event(readTimer);
+    read_timed = false;
 }
 
 void http_connection::remove_write_timer()
 {
-    get_base()->remove_event(writeTimer);
+    write_timed = false;
+}
+
+void http_connection::__touch_timer()
+{
+    auto base = get_base();
+    last_active = base->now();
+    if (timer_queued)
+        return;
+    timer->set_timer(timeout, 0);
+    base->add_event(timer);
+    timer_queued = true;
+}
+
+void http_connection::__cancel_timer()
+{
+    read_timed = write_timed = false;
+    if (timer_queued)
+        get_base()->remove_event(timer);
+    timer_queued = false;
 }
 
 /** private function **/
 
 void http_connection::read_firstline()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
-    auto line = input->readline();
-    enum message_read_status res = req->parse_firstline(line);
+    enum message_read_status res = req->parse_firstline(input);
     if (res == DATA_CORRUPTED)
     {
         /* Error while reading, terminate */
@@ -155,7 +210,7 @@ void http_connection::read_firstline()
 
 void http_connection::read_header()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
     enum message_read_status res = req->parse_headers(input);
@@ -173,6 +228,7 @@ void http_connection::read_header()
     }
 
     /* Done reading headers, do the real work */
+    do_head_done(req);
 
     switch (req->kind)
     {
@@ -199,7 +255,7 @@ void http_connection::read_header()
 
 void http_connection::get_body()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
     /* If this is a request without a body, then we are done */
@@ -209,7 +265,7 @@ void http_connection::get_body()
         return;
     }
     state = READING_BODY;
-    if (req->input_headers["Transfer-Encoding"] == "chunked")
+    if (req->input_headers.get(HEADER_TRANSFER_ENCODING) == "chunked")
     {
         req->chunked = 1;
         req->ntoread = -1;
@@ -228,9 +284,10 @@ void http_connection::get_body()
 
 void http_connection::read_body()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
+    bool done = false;
     if (req->chunked > 0)
     {
         switch (req->handle_chunked_read(input))
@@ -238,8 +295,7 @@ void http_connection::read_body()
         case ALL_DATA_READ:
             /* finished last chunk */
             state = READING_TRAILER;
-            read_trailer();
-            return;
+            break;
         case DATA_CORRUPTED:
             fail(HTTP_INVALID_HEADER);
             return;
@@ -255,22 +311,43 @@ void http_connection::read_body()
         /* Read until connection close. */
         req->input_buffer->push_back_buffer(this->input, -1);
     }
-    else if (get_ibuf_length() >= req->ntoread)
+    else
     {
-        /* Completed content length */
-        req->input_buffer->push_back_buffer(this->input, (size_t)req->ntoread);
-        req->ntoread = 0;
-        do_read_done();
-        return;
+        /* whatever is here of the content length, the input stays below its high mark */
+        long n = std::min<long>(get_ibuf_length(), req->ntoread);
+        req->input_buffer->push_back_buffer(this->input, n);
+        req->ntoread -= n;
+        done = req->ntoread == 0;
+    }
+
+    if (req->chunk_cb && req->input_buffer->get_length() > 0)
+    {
+        in_chunk_cb = true;
+        req->chunk_cb(req);
+        in_chunk_cb = false;
+        req->input_buffer->reset();
+        if (is_closed())
+            return;
+        if (req->body_paused)
+        {
+            /* the peer waits until resume_body() comes back here */
+            remove_read_event();
+            remove_read_timer();
+            return;
+        }
     }
 
-    /* Read more! */
-    add_read_and_timer();
+    if (state == READING_TRAILER)
+        read_trailer();
+    else if (done)
+        do_read_done();
+    else
+        add_read_and_timer(); /* Read more! */
 }
 
 void http_connection::read_trailer()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
     switch (req->parse_headers(input))
@@ -323,6 +400,32 @@ void http_connection::read_http()
     }
 }
 
+void http_connection::handler_timeout(http_connection *conn)
+{
+    conn->timer_queued = false;
+    if (!conn->read_timed && !conn->write_timed)
+        return;
+
+    auto base = conn->get_base();
+    struct timeval deadline, left;
+    struct timeval tv = {conn->timeout, 0};
+    timeradd(&conn->last_active, &tv, &deadline);
+    const struct timeval &now = base->now();
+    if (timercmp(&deadline, &now, >))
+    {
+        /* there was activity since it was queued */
+        timersub(&deadline, &now, &left);
+        conn->timer->set_timer(left.tv_sec, left.tv_usec);
+        base->add_event(conn->timer);
+        conn->timer_queued = true;
+        return;
+    }
+
+    LOG_WARN << "connection " << (conn->read_timed ? "read" : "write") << " timeout fd=" << conn->fd()
+             << " " << conn->peer_address() << ":" << conn->peer_port();
+    conn->fail(HTTP_TIMEOUT);
+}
+
 void http_connection::handler_read(http_connection *conn)
 {
     conn->remove_read_timer();
@@ -332,14 +435,14 @@ void http_connection::handler_read(http_connection *conn)
 void http_connection::handler_eof(http_connection *conn)
 {
     LOG << "connection fd=" << conn->fd();
-    if (conn->get_obuf_length() > 0)
+    if (conn->has_pending_output())
         conn->start_write();
 }
 
 void http_connection::handler_write(http_connection *conn)
 {
     conn->remove_write_timer();
-    if (conn->get_obuf_length() > 0)
+    if (conn->has_pending_output())
     {
         conn->add_write_and_timer();
     }
@@ -11,6 +11,9 @@
 #include <functional>
 #include <mutex>
 
+/* a connection stops reading at this much unparsed input, a message head has to fit */
+#define HTTP_READ_HIGH_WATERMARK (4 * HTTP_MAX_HEAD_SIZE)
+
 namespace eve
 {
 using Lock = std::unique_lock<std::mutex>;
@@ -44,14 +47,24 @@ class http_connection : public buffer_event
 	std::queue<std::unique_ptr<http_request>> requests;
 	std::queue<std::unique_ptr<http_request>> emptyQueue;
 
-	std::shared_ptr<time_event> readTimer = nullptr;
-	std::shared_ptr<time_event> writeTimer = nullptr;
+	/*
+	 * one deadline for reading and writing. activity only moves
+	 * last_active, the timer is queued again when it fires early.
+	 */
+	std::shared_ptr<time_event> timer = nullptr;
+	struct timeval last_active = {0, 0};
+	bool timer_queued = false;
+	bool read_timed = false;  /* waiting for input */
+	bool write_timed = false; /* waiting for the output to drain */
 
 	std::function<void(http_connection *)> closecb = nullptr;
 	std::function<void(http_connection *)> connectioncb = nullptr;
 
 	std::mutex mutex;
 
+	bool in_chunk_cb = false; /* a body is being handed to its chunk_cb */
+	bool corked = false;	  /* start_write() leaves the output to whoever set this */
+
   public:
 	enum http_connection_state state;
 	http_connection(std::shared_ptr<event_base> base, int fd);
@@ -74,7 +87,8 @@ class http_connection : public buffer_event
 		}
 	}
 
-	void reset();
+	virtual void reset();
+	void clear_requests(); /* before the connection is reused for another peer */
 
 	virtual void fail(enum http_connection_error error) = 0;
 
@@ -85,14 +99,28 @@ class http_connection : public buffer_event
 		return state == CLOSED;
 	}
 
+	inline bool is_reading() const
+	{
+		return state == READING_FIRSTLINE || state == READING_HEADERS ||
+			   state == READING_BODY || state == READING_TRAILER;
+	}
+
 	virtual void do_read_done() = 0;
 	virtual void do_write_done() = 0;
+	/* the head of a message is read, its body is not */
+	virtual void do_head_done(http_request *) {}
+
+	/* the other end, for the connections that know it */
+	virtual std::string peer_address() { return ""; }
+	virtual int peer_port() { return 0; }
 
 	void start_read();
 	void start_write();
+	void resume_body(http_request *req); /* reads again what a paused chunk_cb held up */
 
 	void add_read_and_timer();
 	void add_write_and_timer();
+	void add_write_timer();
 
 	void remove_read_timer();
 	void remove_write_timer();
@@ -109,6 +137,9 @@ class http_connection : public buffer_event
 		return requests.front().get();
 	}
 
+	/* the request whose message is being read, the oldest one unless overridden */
+	virtual http_request *reading_request() { return current_request(); }
+
 	inline void pop_req()
 	{
 		if (requests.empty())
@@ -142,6 +173,10 @@ class http_connection : public buffer_event
 	void read_trailer();
 
   private:
+	void __touch_timer();
+	void __cancel_timer();
+
+	static void handler_timeout(http_connection *conn);
 	static void handler_read(http_connection *conn);
 	static void handler_eof(http_connection *conn);
 	static void handler_write(http_connection *conn);
@@ -0,0 +1,104 @@
+#include <http_headers.hh>
+
+#include <algorithm>
+#include <strings.h>
+
+namespace eve
+{
+
+static const std::string EMPTY;
+
+/** class http_headers **/
+
+uint32_t http_headers::header_hash_rt(const char *s, size_t n)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t c = static_cast<uint8_t>(s[i]);
+        if (c >= 'A' && c <= 'Z')
+            c |= 0x20;
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+size_t http_headers::__find(const char *name, size_t len, uint32_t hash) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (hashes[i] == hash && entries[i].first.size() == len &&
+            strncasecmp(entries[i].first.data(), name, len) == 0)
+            return i;
+    }
+    return count;
+}
+
+std::string &http_headers::__insert(const char *name, size_t len, uint32_t hash)
+{
+    size_t i = __find(name, len, hash);
+    if (i < count)
+        return entries[i].second;
+
+    /* a slot left by clear() or erase() is taken before the vector grows */
+    if (count == entries.size())
+    {
+        entries.emplace_back();
+        hashes.push_back(0);
+    }
+    entry &e = entries[count];
+    e.first.assign(name, len);
+    e.second.clear();
+    hashes[count] = hash;
+    count++;
+    return e.second;
+}
+
+size_t http_headers::__erase(const char *name, size_t len, uint32_t hash)
+{
+    size_t i = __find(name, len, hash);
+    if (i == count)
+        return 0;
+
+    /* the erased entry moves behind the used ones, the order of the others stays */
+    std::rotate(entries.begin() + i, entries.begin() + i + 1, entries.begin() + count);
+    std::rotate(hashes.begin() + i, hashes.begin() + i + 1, hashes.begin() + count);
+    count--;
+    return 1;
+}
+
+const std::string *http_headers::find(const std::string &name) const
+{
+    size_t i = __find(name.data(), name.size(), header_hash_rt(name.data(), name.size()));
+    return i < count ? &entries[i].second : nullptr;
+}
+
+const std::string *http_headers::find(const header_name &name) const
+{
+    size_t i = __find(name.name, name.len, name.hash);
+    return i < count ? &entries[i].second : nullptr;
+}
+
+const std::string &http_headers::get(const std::string &name) const
+{
+    const std::string *v = find(name);
+    return v ? *v : EMPTY;
+}
+
+const std::string &http_headers::get(const header_name &name) const
+{
+    const std::string *v = find(name);
+    return v ? *v : EMPTY;
+}
+
+size_t http_headers::erase(const std::string &name)
+{
+    return __erase(name.data(), name.size(), header_hash_rt(name.data(), name.size()));
+}
+
+size_t http_headers::erase(const header_name &name)
+{
+    return __erase(name.name, name.len, name.hash);
+}
+
+} // namespace eve
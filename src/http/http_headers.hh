@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace eve
+{
+
+/* FNV-1a over the lower cased name, the same at compile and at run time */
+constexpr uint32_t header_hash(const char *s, size_t n, uint32_t h = 2166136261u)
+{
+    return n == 0 ? h : header_hash(s + 1, n - 1, (h ^ static_cast<uint8_t>((*s >= 'A' && *s <= 'Z') ? *s | 0x20 : *s)) * 16777619u);
+}
+
+/* a header name whose hash is computed by the compiler */
+struct header_name
+{
+    const char *name;
+    size_t len;
+    uint32_t hash;
+
+    template <size_t N>
+    constexpr explicit header_name(const char (&s)[N])
+        : name(s), len(N - 1), hash(header_hash(s, N - 1)) {}
+};
+
+constexpr header_name HEADER_CONNECTION("Connection");
+constexpr header_name HEADER_CONTENT_LENGTH("Content-Length");
+constexpr header_name HEADER_CONTENT_TYPE("Content-Type");
+constexpr header_name HEADER_DATE("Date");
+constexpr header_name HEADER_HOST("Host");
+constexpr header_name HEADER_PROXY_CONNECTION("Proxy-Connection");
+constexpr header_name HEADER_TRANSFER_ENCODING("Transfer-Encoding");
+
+/**
+ * the headers of one message, in the order they were added.
+ * names are matched case insensitively. clear() keeps the entries and
+ * their strings around, so a request reused on a keep-alive connection
+ * fills them again without allocating. as with std::map a returned value
+ * stays where it is when other headers are added, erase() moves the ones
+ * added after the erased header.
+ **/
+class http_headers
+{
+  public:
+    typedef std::pair<std::string, std::string> entry;
+    typedef std::deque<entry>::iterator iterator;
+    typedef std::deque<entry>::const_iterator const_iterator;
+
+  private:
+    std::deque<entry> entries;    /* [0, count) are in use, growing keeps them in place */
+    std::vector<uint32_t> hashes; /* header_hash() of every name */
+    size_t count = 0;
+
+  public:
+    /* the value of name, like std::map a missing one is added empty */
+    std::string &operator[](const std::string &name) { return insert(name.data(), name.size()); }
+    std::string &operator[](const header_name &name) { return __insert(name.name, name.len, name.hash); }
+    std::string &insert(const char *name, size_t len) { return __insert(name, len, header_hash_rt(name, len)); }
+
+    /* nullptr if there is no such header, nothing is added */
+    const std::string *find(const std::string &name) const;
+    const std::string *find(const header_name &name) const;
+
+    /* the value of name, empty if there is no such header */
+    const std::string &get(const std::string &name) const;
+    const std::string &get(const header_name &name) const;
+
+    size_t erase(const std::string &name);
+    size_t erase(const header_name &name);
+
+    void clear() { count = 0; }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.begin() + count; }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.begin() + count; }
+
+    static uint32_t header_hash_rt(const char *s, size_t n);
+
+  private:
+    size_t __find(const char *name, size_t len, uint32_t hash) const;
+    std::string &__insert(const char *name, size_t len, uint32_t hash);
+    size_t __erase(const char *name, size_t len, uint32_t hash);
+};
+
+} // namespace eve
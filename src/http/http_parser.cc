@@ -0,0 +1,151 @@
+#include <http_parser.hh>
+#include <logger.hh>
+
+#include <cstring>
+
+namespace eve
+{
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+bool string_ref::equals(const char *base, const char *s, size_t n) const
+{
+    return len == n && std::memcmp(base + off, s, n) == 0;
+}
+
+/** class http_parser **/
+
+void http_parser::start(bool firstline)
+{
+    _state = firstline ? FIRSTLINE : HEADERS;
+    _pos = _scan = 0;
+    for (auto &w : first)
+        w = string_ref();
+    headers.clear(); // keeps its capacity for the next message
+}
+
+http_parser::execute_result http_parser::execute(const char *data, size_t len)
+{
+    while (true)
+    {
+        switch (_state)
+        {
+        case DONE:
+            return HEAD_DONE;
+        case IDLE:
+        case CORRUPTED:
+            return BAD_HEAD;
+        default:
+            break;
+        }
+
+        /* only what was not looked at before is searched */
+        const char *nl = _scan < len ? static_cast<const char *>(std::memchr(data + _scan, '\n', len - _scan)) : nullptr;
+        if ((nl ? static_cast<size_t>(nl - data) : len) >= HTTP_MAX_HEAD_SIZE)
+        {
+            LOG_ERROR << "message head longer than " << HTTP_MAX_HEAD_SIZE;
+            _state = CORRUPTED;
+            return BAD_HEAD;
+        }
+        if (!nl)
+        {
+            _scan = len;
+            return NEED_MORE;
+        }
+
+        size_t start = _pos;
+        size_t end = nl - data;
+        _pos = _scan = end + 1;
+        if (end > start && data[end - 1] == '\r')
+            end--;
+
+        if (_state == FIRSTLINE)
+        {
+            if (end == start) // empty lines before the first line are skipped
+                continue;
+            if (!split_firstline(data, start, end - start))
+            {
+                _state = CORRUPTED;
+                return BAD_HEAD;
+            }
+            _state = HEADERS;
+            return FIRSTLINE_DONE;
+        }
+
+        if (end == start)
+        {
+            _state = DONE;
+            return HEAD_DONE;
+        }
+
+        if (is_blank(data[start]) && headers.empty())
+        {
+            /* a continuation of nothing */
+            _state = CORRUPTED;
+            return BAD_HEAD;
+        }
+        __add_header(data, start, end - start);
+    }
+}
+
+bool http_parser::split_firstline(const char *data, size_t off, size_t len)
+{
+    while (len > 0 && is_blank(data[off + len - 1]))
+        len--;
+
+    const char *line = data + off;
+    const char *sp1 = static_cast<const char *>(std::memchr(line, ' ', len));
+    if (!sp1 || sp1 == line)
+        return false;
+
+    size_t w1 = sp1 - line + 1;
+    const char *sp2 = static_cast<const char *>(std::memchr(line + w1, ' ', len - w1));
+    size_t w2 = sp2 ? sp2 - line + 1 : len;
+
+    first[0] = {off, w1 - 1};
+    first[1] = {off + w1, (sp2 ? sp2 - line : len) - w1};
+    first[2] = {off + w2, len - w2};
+    return true;
+}
+
+void http_parser::__add_header(const char *data, size_t off, size_t len)
+{
+    size_t end = off + len;
+    header_ref h;
+
+    if (is_blank(data[off]))
+    {
+        /* folded line, name stays empty */
+        while (off < end && is_blank(data[off]))
+            off++;
+        h.value = {off, end - off};
+        headers.push_back(h);
+        return;
+    }
+
+    const char *colon = static_cast<const char *>(std::memchr(data + off, ':', len));
+    if (!colon)
+    {
+        LOG_ERROR << "parse bad header " << std::string(data + off, len);
+        return;
+    }
+
+    size_t c = colon - data;
+    size_t nend = c;
+    while (nend > off && is_blank(data[nend - 1]))
+        nend--;
+    size_t v = c + 1;
+    while (v < end && is_blank(data[v]))
+        v++;
+    while (end > v && is_blank(data[end - 1]))
+        end--;
+
+    h.name = {off, nend - off};
+    h.value = {v, end - v};
+    headers.push_back(h);
+}
+
+} // namespace eve
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace eve
+{
+
+/* the longest request or status line plus headers we wait for */
+#define HTTP_MAX_HEAD_SIZE (64 * 1024)
+
+/** struct string_ref **
+ *  a piece of the input buffer. kept as an offset from the start of the
+ *  buffer data, so it stays valid while the buffer grows or moves. **/
+struct string_ref
+{
+    size_t off;
+    size_t len;
+
+    string_ref() : off(0), len(0) {}
+    string_ref(size_t off, size_t len) : off(off), len(len) {}
+
+    inline const char *data(const char *base) const { return base + off; }
+    inline std::string str(const char *base) const { return std::string(base + off, len); }
+    bool equals(const char *base, const char *s, size_t n) const;
+};
+
+/* a header line, name.len == 0 continues the value of the header before */
+struct header_ref
+{
+    string_ref name;
+    string_ref value;
+};
+
+/** class http_parser **
+ *  incremental parser of a message head: the request or status line and
+ *  the header lines up to the empty line. execute() is called again with
+ *  the same buffer, grown by whatever arrived since, and goes on where it
+ *  stopped, every byte is scanned once. nothing is copied, the result are
+ *  string_refs into the buffer, valid until the head is drained. **/
+class http_parser
+{
+  public:
+    enum parser_state
+    {
+        IDLE,
+        FIRSTLINE,
+        HEADERS,
+        DONE,
+        CORRUPTED
+    };
+
+    enum execute_result
+    {
+        NEED_MORE,
+        FIRSTLINE_DONE,
+        HEAD_DONE,
+        BAD_HEAD
+    };
+
+  private:
+    parser_state _state = IDLE;
+    size_t _pos = 0;  /* start of the first line not parsed yet */
+    size_t _scan = 0; /* where the search for its end goes on */
+
+  public:
+    /* the three words of the first line: method uri version, or version code reason */
+    string_ref first[3];
+    std::vector<header_ref> headers;
+
+  public:
+    /* a fresh head, with or without the first line */
+    void start(bool firstline);
+    inline void reset() { _state = IDLE; }
+
+    execute_result execute(const char *data, size_t len);
+
+    inline parser_state state() const { return _state; }
+    inline size_t consumed() const { return _pos; } /* length of the head so far */
+
+    /* splits one line without its line break into first[] */
+    bool split_firstline(const char *data, size_t off, size_t len);
+
+  private:
+    void __add_header(const char *data, size_t off, size_t len);
+};
+
+} // namespace eve
@@ -3,6 +3,13 @@
 #include <util_linux.hh>
 #include <http_server.hh>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <string>
 #include <iterator>
 #include <sstream>
@@ -41,12 +48,60 @@ void http_request::reset()
     input_buffer->reset();
     output_buffer->reset();
     uri = query = "";
-    handled = false;
+    params.clear();
+    route = nullptr;
+    remote_host.clear();
+    remote_port = 0;
+    handled = responded = false;
+    flags = 0;
     cb = nullptr;
+    chunk_cb = nullptr;
+    body_paused = false;
     chunked = 0;
     ntoread = 0;
-    std::map<std::string, std::string>().swap(input_headers);
-    std::map<std::string, std::string>().swap(output_headers);
+    parser.reset();
+    input_headers.clear(); // both keep their entries for the next request
+    output_headers.clear();
+}
+
+const std::string &http_request::get_remote_host()
+{
+    /* the address is printed only for those who ask */
+    if (remote_host.empty() && conn)
+    {
+        remote_host = conn->peer_address();
+        remote_port = conn->peer_port();
+    }
+    return remote_host;
+}
+
+unsigned short http_request::get_remote_port()
+{
+    get_remote_host();
+    return remote_port;
+}
+
+void http_request::resume_body()
+{
+    if (!body_paused)
+        return;
+    body_paused = false;
+    if (conn)
+        conn->resume_body(this);
+}
+
+const route_param *http_request::find_param(const std::string &name) const
+{
+    for (const auto &p : params)
+        if (*p.name == name)
+            return &p;
+    return nullptr;
+}
+
+std::string http_request::get_param(const std::string &name) const
+{
+    const route_param *p = find_param(name);
+    return p ? p->value.str(uri.data()) : std::string();
 }
 
 void http_request::send_error(int error, std::string reason)
@@ -61,7 +116,7 @@ void http_request::send_error(int error, std::string reason)
     auto buf = std::unique_ptr<buffer>(new buffer);
     buf->push_back_string(err_page);
 
-    this->input_headers["Connection"] = "close";
+    this->input_headers[HEADER_CONNECTION] = "close";
     this->set_response(error, reason);
 
     send_page(std::move(buf));
@@ -94,8 +149,8 @@ void http_request::send_page(std::unique_ptr<buffer> buf)
         set_response(200, "OK");
 
     output_headers.clear();
-    output_headers["Content-Type"] = "text/html; charset=utf-8";
-    output_headers["Connection"] = "close";
+    output_headers[HEADER_CONTENT_TYPE] = "text/html; charset=utf-8";
+    output_headers[HEADER_CONNECTION] = "close";
 
     __send(std::move(buf));
 }
@@ -111,7 +166,7 @@ void http_request::send_reply_start(int code, const std::string &reason)
     set_response(code, reason);
     if (major == 1 && minor == 1)
     {
-        output_headers["Transfer-Encoding"] = "chunked";
+        output_headers[HEADER_TRANSFER_ENCODING] = "chunked";
         chunked = 1;
     }
     make_header();
@@ -142,6 +197,47 @@ void http_request::send_reply_end()
         conn->start_write();
         chunked = 0;
     }
+    responded = true;
+}
+
+int http_request::send_file(const std::string &path, off_t offset, ssize_t length)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        LOG_WARN << "can not open " << path << " errno=" << errno;
+        return -1;
+    }
+    return send_file(fd, offset, length);
+}
+
+int http_request::send_file(int fd, off_t offset, ssize_t length)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || offset < 0 || offset > st.st_size)
+    {
+        close(fd);
+        return -1;
+    }
+    if (length < 0 || length > st.st_size - offset)
+        length = st.st_size - offset;
+
+    set_response(HTTP_OK, "OK");
+    output_buffer->reset();
+    output_headers[HEADER_CONTENT_LENGTH] = std::to_string(length);
+    std::string &content_type = output_headers[HEADER_CONTENT_TYPE];
+    if (content_type.empty())
+        content_type = "application/octet-stream";
+    make_header();
+
+    if (type == REQ_HEAD)
+        close(fd);
+    else
+        conn->write_file(fd, offset, length);
+
+    responded = true;
+    conn->start_write();
+    return 0;
 }
 
 enum message_read_status
@@ -151,107 +247,141 @@ http_request::parse_firstline(const std::string &line)
     if (line.empty())
         return MORE_DATA_EXPECTED;
 
-    enum message_read_status status = ALL_DATA_READ;
+    if (kind != REQUEST && kind != RESPONSE)
+        return DATA_CORRUPTED;
+    if (!parser.split_firstline(line.data(), 0, line.size()) || __set_firstline(line.data()) == -1)
+        return DATA_CORRUPTED;
+    return ALL_DATA_READ;
+}
+
+/* the first line stays in buf, it is drained with the headers */
+enum message_read_status
+http_request::parse_firstline(std::unique_ptr<buffer> &buf)
+{
+    if (parser.state() != http_parser::FIRSTLINE)
+        parser.start(true);
 
-    switch (kind)
+    const char *data = buf->get_data();
+    switch (parser.execute(data, buf->get_length()))
     {
-    case REQUEST:
-        if (__parse_request_line(line) == -1)
-            status = DATA_CORRUPTED;
-        break;
-    case RESPONSE:
-        if (__parse_response_line(line) == -1)
-            status = DATA_CORRUPTED;
-        break;
+    case http_parser::NEED_MORE:
+        return MORE_DATA_EXPECTED;
+    case http_parser::FIRSTLINE_DONE:
+        if (kind != REQUEST && kind != RESPONSE)
+            return DATA_CORRUPTED;
+        return __set_firstline(data) == -1 ? DATA_CORRUPTED : ALL_DATA_READ;
     default:
-        status = DATA_CORRUPTED;
-        break;
+        return DATA_CORRUPTED;
     }
-    return status;
 }
 
 enum message_read_status
 http_request::parse_headers(std::unique_ptr<buffer> &buf)
 {
-    std::string line;
-    // enum message_read_status status = MORE_DATA_EXPECTED;
+    /* a trailer, or headers whose first line was taken some other way */
+    if (parser.state() != http_parser::HEADERS)
+        parser.start(false);
 
-    std::string k, v;
-    while (1)
+    const char *data = buf->get_data();
+    switch (parser.execute(data, buf->get_length()))
     {
-        line = buf->readline();
-        if (line.empty()) /* done */
-            return ALL_DATA_READ;
-
-        /* Check if this is a continuation line */
-        if (line[0] == ' ' || line[0] == '\t')
-        {
-            if (k.empty())
-                return DATA_CORRUPTED;
-            ltrim(line, " \t");
-            v += line;
-            this->input_headers[k] = v;
-            continue;
-        }
-
-        /* Processing of header lines */
-        auto pos = line.find(':', 0);
-        if (pos == std::string::npos)
-        {
-            LOG_ERROR << "parse bad header " << line;
-            continue;
-        }
-        k = line.substr(0, pos);
-        v = line.substr(pos + 1);
-        k = trim(k);
-        v = trim(v);
-        this->input_headers[k] = v;
+    case http_parser::NEED_MORE:
+        return MORE_DATA_EXPECTED;
+    case http_parser::HEAD_DONE:
+        __set_headers(data);
+        buf->drain(parser.consumed());
+        parser.reset();
+        return ALL_DATA_READ;
+    default:
+        return DATA_CORRUPTED;
     }
+}
 
-    return ALL_DATA_READ;
+/*
+ * the size of a chunk size line [p, nl). hex digits up to a ';' of the
+ * extensions or the CR of the line end, -1 for anything else or a size
+ * that does not fit a long
+ */
+static long parse_chunk_size(const char *p, const char *nl)
+{
+    long size = 0;
+    const char *s = p;
+    for (; s < nl; s++)
+    {
+        int d;
+        if (*s >= '0' && *s <= '9')
+            d = *s - '0';
+        else if (*s >= 'a' && *s <= 'f')
+            d = *s - 'a' + 10;
+        else if (*s >= 'A' && *s <= 'F')
+            d = *s - 'A' + 10;
+        else
+            break;
+        if (size > (LONG_MAX >> 4))
+            return -1;
+        size = size * 16 + d;
+    }
+    if (s == p)
+        return -1;
+    if (s == nl || *s == ';' || (*s == '\r' && s + 1 == nl))
+        return size;
+    return -1;
 }
 
 enum message_read_status
 http_request::handle_chunked_read(std::unique_ptr<buffer> &buf)
 {
-    std::string line;
+    /* a chunk is taken in whatever pieces it arrives, chunk_cb sees them as they come */
     while (buf->get_length() > 0)
     {
+        const char *data = buf->get_data();
+        size_t len = buf->get_length();
+
+        if (ntoread == -2)
+        {
+            /* the line end after the data of a chunk */
+            size_t n = data[0] == '\n' ? 1 : 2;
+            if (len < n)
+                return MORE_DATA_EXPECTED;
+            if (n == 2 && (data[0] != '\r' || data[1] != '\n'))
+                return DATA_CORRUPTED;
+            buf->drain(n);
+            ntoread = -1;
+            continue;
+        }
+
         if (ntoread < 0)
         {
-            /* Read chunk size */
-            line = buf->readline();
-            long ntoread = std::stol(line, 0, 16);
-            if (line.empty() || ntoread < 0)
+            /* the size line, extensions after ';' are ignored */
+            const char *nl = static_cast<const char *>(std::memchr(data, '\n', len));
+            if (!nl)
+                return len > 1024 ? DATA_CORRUPTED : MORE_DATA_EXPECTED;
+            long size = parse_chunk_size(data, nl);
+            if (size < 0)
                 return DATA_CORRUPTED;
-            this->ntoread = ntoread;
-            if (this->ntoread == 0)
+            buf->drain(nl - data + 1);
+            if (size == 0)
             {
-                return ALL_DATA_READ;
+                ntoread = 0;
+                return ALL_DATA_READ; /* the trailer follows */
             }
+            ntoread = size;
             continue;
         }
 
-        /* don't have enough to complete a chunk; wait for more */
-        if (buf->get_length() < this->ntoread)
-            return MORE_DATA_EXPECTED;
-
-        /* Completed chunk */
-        this->input_buffer->push_back_buffer(buf, (size_t)this->ntoread + 2); /* here 2 is for /r/n */
-        this->ntoread = -1;
-        // if (!this->chunk_cb)
-        // {
-        //     (*this->chunk_cb)(this);
-        //     this->input_buffer->reset();
-        // }
+        size_t n = std::min(len, static_cast<size_t>(ntoread));
+        input_buffer->push_back_buffer(buf, n);
+        ntoread -= n;
+        if (ntoread == 0)
+            ntoread = -2;
     }
     return MORE_DATA_EXPECTED;
 }
 
 int http_request::get_body_length()
 {
-    std::string content_length = input_headers["Content-Length"];
-    std::string connection = input_headers["Connection"];
+    const std::string &content_length = input_headers.get(HEADER_CONTENT_LENGTH);
+    const std::string &connection = input_headers.get(HEADER_CONNECTION);
 
     if (content_length.empty() && connection.empty())
         ntoread = -1;
@@ -281,21 +411,29 @@ int http_request::get_body_length()
 
 void http_request::make_header()
 {
+    /* the whole header block is rendered first and copied out once */
+    std::string head;
+    head.reserve(256);
     if (kind == REQUEST)
-        __make_header_request();
+        __make_header_request(head);
     else
-        __make_header_response();
+        __make_header_response(head);
 
     for (const auto &kv : output_headers)
-        conn->write_string(kv.first + ": " + kv.second + "\r\n");
-
-    conn->write_string("\r\n");
+    {
+        head += kv.first;
+        head += ": ";
+        head += kv.second;
+        head += "\r\n";
+    }
+    head += "\r\n";
+    conn->write_string(head);
 
     if (this->output_buffer->get_length() > 0)
     {
         /*
 		 * For a request, we add the POST data, for a reply, this
-		 * is the regular data.
+		 * is the regular data. the connection takes the array over
 		 */
         conn->write_buffer(output_buffer);
     }
@@ -303,100 +441,112 @@ void http_request::make_header()
 
 void http_request::__send(std::unique_ptr<buffer> databuf)
 {
-    this->output_buffer->push_back_buffer(databuf, -1);
+    if (databuf && this->output_buffer->get_length() == 0)
+        this->output_buffer.swap(databuf); // the body is never copied
+    else
+        this->output_buffer->push_back_buffer(databuf, -1);
 
     /* Adds headers to the response */
     make_header();
 
+    responded = true;
     conn->start_write();
 }
 
 /**
  * the request should be :  method uri version
+ * the response should be : version code reason
  */
-int http_request::__parse_request_line(std::string line)
+int http_request::__set_firstline(const char *base)
 {
-    std::istringstream iss(line);
-    std::vector<std::string> words = split(line, ' ');
-    if (words.size() < 3)
+    const string_ref *w = parser.first;
+    const string_ref &version = kind == REQUEST ? w[2] : w[0];
+
+    if (version.equals(base, "HTTP/1.0", 8))
     {
-        LOG_ERROR << "receved bad request line=" << line;
+        this->major = 1;
+        this->minor = 0;
+    }
+    else if (version.equals(base, "HTTP/1.1", 8))
+    {
+        this->major = 1;
+        this->minor = 1;
+    }
+    else
+    {
+        LOG_ERROR << "bad version:" << version.str(base) << " on request:" << get_remote_host();
         return -1;
     }
 
-    std::string method = words[0];
-    std::string uri = words[1];
-    std::string version = words[2];
+    if (kind == RESPONSE)
+    {
+        const string_ref &code = w[1];
+        if (code.len != 3)
+        {
+            LOG_ERROR << "bad response code:" << code.str(base);
+            return -1;
+        }
+        this->response_code = 0;
+        for (size_t i = 0; i < 3; i++)
+        {
+            char c = code.data(base)[i];
+            if (c < '0' || c > '9')
+            {
+                LOG_ERROR << "bad response code:" << code.str(base);
+                return -1;
+            }
+            this->response_code = this->response_code * 10 + (c - '0');
+        }
+        this->response_code_line = w[2].str(base);
+        return 0;
+    }
 
-    if (method == "GET")
+    const string_ref &method = w[0];
+    if (method.equals(base, "GET", 3))
         this->type = REQ_GET;
-    else if (method == "POST")
+    else if (method.equals(base, "POST", 4))
         this->type = REQ_POST;
-    else if (method == "HEAD")
+    else if (method.equals(base, "HEAD", 4))
         this->type = REQ_HEAD;
     else
     {
-        LOG_ERROR << "bad method:" << method << " on request:" << this->remote_host;
+        LOG_ERROR << "bad method:" << method.str(base) << " on request:" << get_remote_host();
         return -1;
     }
 
-    if (version == "HTTP/1.0")
-    {
-        this->major = 1;
-        this->minor = 0;
-    }
-    else if (version == "HTTP/1.1")
-    {
-        this->major = 1;
-        this->minor = 1;
-    }
-    else
+    if (w[1].len == 0)
     {
-        LOG_ERROR << "bad version:" << version << " on request:" << this->remote_host;
+        LOG_ERROR << "no uri on request:" << get_remote_host();
         return -1;
     }
-    this->uri = uri;
+    this->uri.assign(w[1].data(base), w[1].len);
 
     /* determine if it's a proxy request */
-    if (uri.size() > 0 && uri[0] != '/')
+    if (uri[0] != '/')
         this->flags |= PROXY_REQUEST;
 
     return 0;
 }
 
-int http_request::__parse_response_line(std::string line)
+void http_request::__set_headers(const char *base)
 {
-    auto found1 = line.find(' ');
-    std::string protocol = line.substr(0, found1);
-    auto found2 = line.find(' ', found1 + 1);
-    std::string number = line.substr(found1 + 1, found2 - found1 - 1);
-    std::string readable = line.substr(found2 + 1);
-
-    if (protocol == "HTTP/1.0")
+    std::string *last = nullptr;
+    for (const auto &h : parser.headers)
     {
-        this->major = 1;
-        this->minor = 0;
-    }
-    else if (protocol == "HTTP/1.1")
-    {
-        this->major = 1;
-        this->minor = 1;
-    }
-    else
-    {
-        LOG_ERROR << "bad protocol:" << protocol << " on request:" << this->remote_host;
-        return -1;
+        if (h.name.len == 0) // continuation line
+        {
+            if (last)
+                last->append(h.value.data(base), h.value.len);
+            continue;
+        }
+        last = &input_headers.insert(h.name.data(base), h.name.len);
+        last->assign(h.value.data(base), h.value.len);
     }
-
-    this->response_code = std::stoi(number);
-    this->response_code_line = readable;
-
-    return 0;
 }
 
-void http_request::__make_header_request()
+void http_request::__make_header_request(std::string &head)
 {
-    output_headers.erase("Proxy-Connection");
+    output_headers.erase(HEADER_PROXY_CONNECTION);
 
     std::string method;
     switch (type)
@@ -415,59 +565,54 @@ void http_request::__make_header_request()
         break;
     }
 
-    std::string str = method + " " + uri + " HTTP/" + std::to_string(major) + "." + std::to_string(minor) + "\r\n";
-    conn->write_string(str);
+    head += method + " " + uri + " HTTP/" + std::to_string(major) + "." + std::to_string(minor) + "\r\n";
 
     /* Add the content length on a post request if missing */
-    if (type == REQ_POST && output_headers["Content-Length"].empty())
-    {
-        std::string size = std::to_string(output_buffer->get_length());
-        this->output_headers["Content-Length"] = size;
-    }
+    if (type == REQ_POST && output_headers.get(HEADER_CONTENT_LENGTH).empty())
+        this->output_headers[HEADER_CONTENT_LENGTH] = std::to_string(output_buffer->get_length());
 }
 
-void http_request::__make_header_response()
+void http_request::__make_header_response(std::string &head)
 {
     int is_keepalive = is_connection_keepalive();
-    std::string s = "HTTP/" + std::to_string(major) + "." + std::to_string(minor) + " " + std::to_string(response_code) + " " + response_code_line + "\r\n";
-    conn->write_string(s);
+    head += "HTTP/" + std::to_string(major) + "." + std::to_string(minor) + " " + std::to_string(response_code) + " " + response_code_line + "\r\n";
 
     if (major == 1)
     {
-        if (minor == 1 && output_headers["Date"].empty())
-            output_headers["Date"] = get_date();
+        if (minor == 1 && output_headers.get(HEADER_DATE).empty())
+            output_headers[HEADER_DATE] = get_date();
 
         /*
 		 * if the protocol is 1.0; and the connection was keep-alive
 		 * we need to add a keep-alive header, too.
 		 */
         if (minor == 0 && is_keepalive)
-            output_headers["Connection"] = "keep-alive";
+            output_headers[HEADER_CONNECTION] = "keep-alive";
 
         if (minor == 1 || is_keepalive)
         {
-            output_headers["Connection"] = "keep-alive";
+            output_headers[HEADER_CONNECTION] = "keep-alive";
             /* 
 			 * we need to add the content length if the
 			 * user did not give it, this is required for
 			 * persistent connections to work.
 			 */
-            if (output_headers["Transfer-Encoding"].empty() && output_headers["Content-Length"].empty())
-                output_headers["Content-Length"] = std::to_string(output_buffer->get_length());
+            if (output_headers.get(HEADER_TRANSFER_ENCODING).empty() && output_headers.get(HEADER_CONTENT_LENGTH).empty())
+                output_headers[HEADER_CONTENT_LENGTH] = std::to_string(output_buffer->get_length());
         }
     }
 
     /* Potentially add headers for unidentified content. */
-    if (output_buffer->get_length() > 0 && output_headers["Content-Type"].empty())
-        output_headers["Content-Type"] = "text/html; charset=utf-8";
+    if (output_buffer->get_length() > 0 && output_headers.get(HEADER_CONTENT_TYPE).empty())
+        output_headers[HEADER_CONTENT_TYPE] = "text/html; charset=utf-8";
 
     /* if the request asked for a close, we send a close, too */
     if (is_in_connection_close())
     {
-        output_headers.erase("Connection");
+        output_headers.erase(HEADER_CONNECTION);
         if (flags & PROXY_REQUEST)
-            output_headers["Connection"] = "Close";
-        output_headers.erase("Proxy-Connection");
+            output_headers[HEADER_CONNECTION] = "Close";
+        output_headers.erase(HEADER_PROXY_CONNECTION);
     }
 }
 
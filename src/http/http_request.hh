@@ -1,12 +1,17 @@
 #pragma once
 
 #include <buffer.hh>
+#include <http_headers.hh>
+#include <http_parser.hh>
 #include <util_string.hh>
 
+#include <sys/types.h>
+
 #include <string>
 #include <cstring>
 #include <map>
 #include <memory>
+#include <vector>
 #include <functional>
 #include <iostream>
 
@@ -44,27 +49,37 @@ enum message_read_status
 #define HTTP_NOTFOUND 404
 #define HTTP_SERVUNAVAIL 503
 
+/* a ":name", "*" or "**" segment of the route a request took, the value is a range of its uri */
+struct route_param
+{
+    const std::string *name;
+    string_ref value;
+};
+
 class event_base;
 class http_connection;
+struct http_route;
 class http_request
 {
   private:
   public:
-    http_connection *conn;
+    http_connection *conn = nullptr;
     std::unique_ptr<buffer> input_buffer;
     std::unique_ptr<buffer> output_buffer;
-    int flags;
+    int flags = 0;
 #define REQ_OWN_CONNECTION 0x0001
 #define PROXY_REQUEST 0x0002
 
-    /* address of the remote host and the port connection came from */
+    /* address of the remote host and the port connection came from, filled in by get_remote_host() on the server */
     std::string remote_host;
-    unsigned short remote_port;
+    unsigned short remote_port = 0;
 
     enum http_request_kind kind;
     enum http_cmd_type type;
     std::string uri;          /* uri after HTTP request was parsed */
     std::string query;        /* query part in original uri */
+    std::vector<route_param> params; /* filled in by the router */
+    const http_route *route = nullptr; /* what the server found for uri, once the head is read */
     unsigned short major = 1; /* HTTP Major number */
     unsigned short minor = 1; /* HTTP Minor number */
 
@@ -72,16 +87,26 @@ class http_request
     std::string response_code_line; /* Readable response */
 
     bool handled = false;
+    bool responded = false; /* the whole response is in the connection's output */
 
-    long ntoread;
+    long ntoread; /* of the body, on a chunked one -1 waits for a size line and -2 for the end of a chunk */
     int chunked = 0;
 
     // void (*cb)(http_request *) = nullptr;
     std::function<void(http_request *)> cb = nullptr;
-    // void (*chunk_cb)(http_request *);
+    /*
+     * the body as it arrives: input_buffer holds what came since the last
+     * call and is emptied afterwards. a handler that can not keep up calls
+     * pause_body(), nothing more is read from the peer until resume_body().
+     */
+    std::function<void(http_request *)> chunk_cb = nullptr;
+    bool body_paused = false;
+
+    http_headers input_headers;
+    http_headers output_headers;
 
-    std::map<std::string, std::string> input_headers;
-    std::map<std::string, std::string> output_headers;
+  private:
+    http_parser parser; /* the head being read, resumed as more input comes */
 
   public:
     http_request();
@@ -90,6 +115,16 @@ class http_request
 
     void reset();
 
+    const std::string &get_remote_host();
+    unsigned short get_remote_port();
+
+    inline void pause_body() { body_paused = true; }
+    void resume_body();
+
+    /* the route parameter called name, nullptr if there is none */
+    const route_param *find_param(const std::string &name) const;
+    std::string get_param(const std::string &name) const;
+
     inline void set_response(int code, const std::string &reason)
     {
         this->kind = RESPONSE;
@@ -101,7 +136,7 @@ class http_request
 
     inline int is_connection_keepalive()
     {
-        std::string connection = input_headers["Connection"];
+        const std::string &connection = input_headers.get(HEADER_CONNECTION);
         return (!connection.empty() && iequals_n(connection, "keep-alive", 10));
     }
 
@@ -109,12 +144,12 @@ class http_request
     {
         if (flags & PROXY_REQUEST)
         {
-            std::string connection = this->input_headers["Proxy-Connectioin"];
+            const std::string &connection = this->input_headers.get("Proxy-Connectioin");
             return (connection.empty() || iequals(connection, "keep-alive"));
         }
         else
         {
-            std::string connection = this->input_headers["Connection"];
+            const std::string &connection = this->input_headers.get(HEADER_CONNECTION);
             return (!connection.empty() && iequals(connection, "close"));
         }
     }
@@ -122,12 +157,12 @@ class http_request
     {
         if (flags & PROXY_REQUEST)
         {
-            std::string connection = output_headers["Proxy-Connectioin"];
+            const std::string &connection = output_headers.get("Proxy-Connectioin");
             return (connection.empty() || iequals(connection, "keep-alive"));
         }
         else
         {
-            std::string connection = output_headers["Connection"];
+            const std::string &connection = output_headers.get(HEADER_CONNECTION);
             return (!connection.empty() && iequals(connection, "close"));
         }
     }
@@ -139,6 +174,7 @@ class http_request
     int get_body_length();
 
     enum message_read_status parse_firstline(const std::string &line);
+    enum message_read_status parse_firstline(std::unique_ptr<buffer> &buf);
     enum message_read_status parse_headers(std::unique_ptr<buffer> &buf);
     enum message_read_status handle_chunked_read(std::unique_ptr<buffer> &buf);
 
@@ -150,16 +186,24 @@ class http_request
     void send_reply_chunk(std::unique_ptr<buffer> buf);
     void send_reply_end();
 
+    /* 
+     * headers go out normally, the body is sent from the file with sendfile().
+     * the fd is owned by the request from then on, a length of -1 means up to
+     * the end of the file. -1 if the file can not be sent, nothing is written.
+     */
+    int send_file(const std::string &path, off_t offset = 0, ssize_t length = -1);
+    int send_file(int fd, off_t offset = 0, ssize_t length = -1);
+
     void make_header();
 
   private:
     void __send(std::unique_ptr<buffer> databuf);
 
-    int __parse_request_line(std::string line);
-    int __parse_response_line(std::string line);
+    int __set_firstline(const char *base);
+    void __set_headers(const char *base);
 
-    void __make_header_request();
-    void __make_header_response();
+    void __make_header_request(std::string &head);
+    void __make_header_response(std::string &head);
 };
 
 } // namespace eve
@@ -0,0 +1,189 @@
+#include <http_router.hh>
+#include <logger.hh>
+
+#include <cstring>
+
+namespace eve
+{
+
+/** class http_router **/
+
+int http_router::add(const std::string &pattern, const HandleCallBack &cb, const HandleCallBack &body_cb)
+{
+    auto r = std::unique_ptr<route>(new route);
+    r->pattern = pattern;
+    r->cb = cb;
+    r->body_cb = body_cb;
+
+    /* anything but a path, like "*", only matches itself */
+    if (pattern.empty() || pattern[0] != '/')
+    {
+        node *n = __insert_static(&root, pattern.data(), pattern.size());
+        if (n->end)
+        {
+            LOG_WARN << "route " << pattern << " is shadowed by " << n->end->pattern;
+            return -1;
+        }
+        n->end = r.get();
+        routes.push_back(std::move(r));
+        return 0;
+    }
+
+    /* static text runs up to a parameter segment, which becomes a node of its own */
+    node *n = &root;
+    size_t run = 0; // start of the static text not inserted yet
+    size_t pos = 0;
+    bool mount = false;
+    while (pos < pattern.size())
+    {
+        size_t seg = pos + 1; // after the '/'
+        size_t next = pattern.find('/', seg);
+        if (next == std::string::npos)
+            next = pattern.size();
+        const char *s = pattern.data() + seg;
+        size_t slen = next - seg;
+
+        bool is_param = slen > 1 && s[0] == ':';
+        bool is_star = slen == 1 && s[0] == '*';
+        bool is_mount = slen == 2 && s[0] == '*' && s[1] == '*';
+        if (is_mount && next != pattern.size())
+        {
+            LOG_ERROR << "'**' has to end the route: " << pattern;
+            return -1;
+        }
+
+        if (is_param || is_star || is_mount)
+        {
+            n = __insert_static(n, pattern.data() + run, seg - run);
+            if (is_mount)
+            {
+                r->names.push_back("**");
+                mount = true;
+                break;
+            }
+            if (!n->param)
+                n->param = std::unique_ptr<node>(new node);
+            n = n->param.get();
+            r->names.push_back(is_star ? std::string("*") : std::string(s + 1, slen - 1));
+            run = next;
+        }
+        pos = next;
+    }
+    if (!mount)
+        n = __insert_static(n, pattern.data() + run, pattern.size() - run);
+
+    const route *&slot = mount ? n->mount : n->end;
+    if (slot)
+    {
+        LOG_WARN << "route " << pattern << " is shadowed by " << slot->pattern;
+        return -1;
+    }
+    slot = r.get();
+    routes.push_back(std::move(r));
+    return 0;
+}
+
+void http_router::clear()
+{
+    routes.clear();
+    root = node();
+}
+
+http_router::node *http_router::__insert_static(node *n, const char *s, size_t len)
+{
+    while (len > 0)
+    {
+        size_t i = n->indices.find(s[0]);
+        if (i == std::string::npos)
+        {
+            auto c = std::unique_ptr<node>(new node);
+            c->path.assign(s, len);
+            n->indices.push_back(s[0]);
+            n->children.push_back(std::move(c));
+            return n->children.back().get();
+        }
+
+        node *c = n->children[i].get();
+        size_t common = 0;
+        while (common < len && common < c->path.size() && c->path[common] == s[common])
+            common++;
+
+        if (common < c->path.size())
+        {
+            /* the edge splits, what is left of it hangs below the common part */
+            auto mid = std::unique_ptr<node>(new node);
+            mid->path = c->path.substr(0, common);
+            c->path.erase(0, common);
+            mid->indices.push_back(c->path[0]);
+            mid->children.push_back(std::move(n->children[i]));
+            n->children[i] = std::move(mid);
+            c = n->children[i].get();
+        }
+        n = c;
+        s += common;
+        len -= common;
+    }
+    return n;
+}
+
+const http_router::route *http_router::__match(const node *n, const char *path, size_t pos, size_t len,
+                                               std::vector<route_param> &params) const
+{
+    if (pos == len && n->end)
+        return n->end;
+
+    if (pos < len)
+    {
+        size_t i = n->indices.find(path[pos]);
+        if (i != std::string::npos)
+        {
+            const node *c = n->children[i].get();
+            if (len - pos >= c->path.size() && std::memcmp(path + pos, c->path.data(), c->path.size()) == 0)
+            {
+                const route *r = __match(c, path, pos + c->path.size(), len, params);
+                if (r)
+                    return r;
+            }
+        }
+
+        if (n->param)
+        {
+            const char *slash = static_cast<const char *>(std::memchr(path + pos, '/', len - pos));
+            size_t end = slash ? slash - path : len;
+            if (end > pos)
+            {
+                params.push_back({nullptr, string_ref(pos, end - pos)});
+                const route *r = __match(n->param.get(), path, end, len, params);
+                if (r)
+                    return r;
+                params.pop_back();
+            }
+        }
+    }
+
+    if (n->mount)
+    {
+        params.push_back({nullptr, string_ref(pos, len - pos)});
+        return n->mount;
+    }
+    return nullptr;
+}
+
+const http_route *http_router::match(const std::string &path, std::vector<route_param> &params) const
+{
+    params.clear();
+    const route *r = __match(&root, path.data(), 0, path.size(), params);
+    /* one trailing '/' is not part of the route, "/test/" is "/test" */
+    if (!r && path.size() > 1 && path.back() == '/')
+    {
+        params.clear();
+        r = __match(&root, path.data(), 0, path.size() - 1, params);
+    }
+    if (!r)
+        return nullptr;
+    for (size_t i = 0; i < params.size(); i++)
+        params[i].name = &r->names[i];
+    return r;
+}
+
+} // namespace eve
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <http_request.hh>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace eve
+{
+using HandleCallBack = std::function<void(http_request *)>;
+
+/* a pattern and its handlers, as match() hands it out */
+struct http_route
+{
+    std::string pattern;
+    HandleCallBack cb;
+    HandleCallBack body_cb;         /* gets the body as it arrives, may be empty */
+    std::vector<std::string> names; /* of the parameters, in uri order */
+};
+
+/** class http_router **
+ *  the handlers of http_server as a radix tree over the uri. a pattern is
+ *  made of static segments, ":name" and "*" which take one segment, and a
+ *  trailing "**" which takes the rest of the uri, a handler so mounted on
+ *  /files gets everything below /files/. a pattern not starting with '/'
+ *  is taken as it is. at every node static text is tried before a
+ *  segment parameter and that before a mount, the tree backtracks when a
+ *  branch leads nowhere. **/
+class http_router
+{
+  private:
+    typedef http_route route;
+
+    struct node
+    {
+        std::string path;                            /* static text on the edge into this node */
+        std::string indices;                         /* first byte of every static child */
+        std::vector<std::unique_ptr<node>> children; /* static, in the order of indices */
+        std::unique_ptr<node> param;                 /* ":name" or "*", up to the next '/' */
+        const route *end = nullptr;                  /* a pattern ending here */
+        const route *mount = nullptr;                /* a "**" pattern ending here */
+    };
+
+    std::vector<std::unique_ptr<route>> routes;
+    node root;
+
+  public:
+    /* -1 if the pattern does not parse or is already taken, the reason is logged */
+    int add(const std::string &pattern, const HandleCallBack &cb, const HandleCallBack &body_cb = nullptr);
+    void clear();
+    inline size_t size() const { return routes.size(); }
+
+    /*
+     * the route of path or nullptr, a trailing '/' of path is tried
+     * without it. params gets the values of the parameter segments as
+     * ranges of path, it keeps its capacity.
+     */
+    const http_route *match(const std::string &path, std::vector<route_param> &params) const;
+
+  private:
+    node *__insert_static(node *n, const char *s, size_t len);
+    const route *__match(const node *n, const char *path, size_t pos, size_t len, std::vector<route_param> &params) const;
+};
+
+} // namespace eve
@@ -4,6 +4,10 @@
 #include <event_base.hh>
 #include <util_linux.hh>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <string>
 
 namespace eve
@@ -17,6 +21,9 @@ http_server::~http_server()
         threads[i]->terminate();
         threads[i]->wakeup();
     }
+    /* the loops run on the threads, they have to be done before the threads go */
+    pool->stop(true);
+    closefd(stop_fd);
 }
 
 static void loop_task(http_server_thread *thread)
@@ -45,13 +52,28 @@ void http_server::resize_thread_pool(int nThreads)
 
 static void __listen_cb(int fd, http_server *server)
 {
-    std::string host;
-    int port;
-    int nfd = accept_socket(fd, host, port);
-    LOG << "[server] ===> new client in with fd=" << nfd << " hostname=" << host << " portname=" << port << "\n";
+    /* everything in the backlog is taken in one callback */
+    http_client_info client;
+    size_t n = 0;
+    client.addrlen = sizeof(client.addr);
+    while ((client.nfd = accept_socket(fd, &client.addr, &client.addrlen)) != -1)
+    {
+        LOG << "[server] ===> new client in with fd=" << client.nfd;
+        if (!server->hand_over(client))
+        {
+            LOG_WARN << "[server] every thread is full, drop client fd=" << client.nfd;
+            closefd(client.nfd);
+        }
+        client.addrlen = sizeof(client.addr);
+        n++;
+    }
+    server->accepts.record(n);
+}
 
-    server->clientQueue.push(std::unique_ptr<http_client_info>(new http_client_info(nfd, host, port)));
-    server->wakeup_random(2);
+static void __stop_cb(std::shared_ptr<rw_event> ev)
+{
+    read_wake_msg(ev->fd);
+    ev->get_base()->set_terminated();
 }
 /*
  * Start a web server on the specified address and port.
@@ -61,26 +83,110 @@ int http_server::start(const std::string &address, unsigned short port)
     if (threads.size() == 0)
         resize_thread_pool(4);
 
-    int fd = bind_socket(address, port, 1 /*reuse*/);
-    if (fd == -1)
-        exit(-1);
-
-    if (listenfd(fd) == -1)
+    if (compile_routes() == -1)
         return -1;
 
-    /* use a read event to listen on the fd */
-    auto ev = create_event<rw_event>(base, fd, READ);
-    base->register_callback(ev, __listen_cb, fd, this);
-    ev->set_persistent();
-    base->add_event(ev);
+    if (reuse_port)
+    {
+        /* one socket per thread, the kernel spreads the connections over them */
+        std::vector<int> fds;
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            int fd = bind_socket(address, port, 1 /*reuse*/, 1 /*reuse_port*/);
+            if (fd == -1 || listenfd(fd, backlog) == -1)
+            {
+                if (fd != -1)
+                    closefd(fd);
+                for (int f : fds)
+                    closefd(f);
+                return -1;
+            }
+            fds.push_back(fd);
+        }
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i]->listen(fds[i]);
+
+        LOG << "[server] " << fds.size() << " threads bound to port " << port << " - Awaiting connections ...";
+    }
+    else
+    {
+        int fd = bind_socket(address, port, 1 /*reuse*/);
+        if (fd == -1)
+            return -1;
+
+        if (listenfd(fd, backlog) == -1)
+        {
+            closefd(fd);
+            return -1;
+        }
+
+        /* use a read event to listen on the fd */
+        listener = create_event<rw_event>(base, fd, READ);
+        base->register_callback(listener, __listen_cb, fd, this);
+        listener->set_persistent();
+        base->add_event(listener);
+
+        LOG << "[server] Listening on fd = " << fd;
+        LOG << "[server] Bound to port " << port << " - Awaiting connections ...";
+    }
 
-    LOG << "[server] Listening on fd = " << fd;
-    LOG << "[server] Bound to port " << port << " - Awaiting connections ...";
+    /* stop() only ever touches stop_fd, the rw_event closes its own copy */
+    stopper = create_event<rw_event>(base, fcntl(stop_fd, F_DUPFD_CLOEXEC, 0), READ);
+    stopper->set_persistent();
+    base->register_callback(stopper, __stop_cb, stopper);
+    base->add_event(stopper);
 
     base->loop();
+
+    /* the loop has let go of its events, each rw_event closes its fd as it goes */
+    listener = nullptr;
+    stopper = nullptr;
     return 0;
 }
 
+bool http_server::hand_over(const http_client_info &client)
+{
+    for (size_t k = 0; k < threads.size(); k++)
+    {
+        size_t i = next_thread++ % threads.size();
+        if (threads[i]->hand_over(client))
+            return true;
+    }
+    return false;
+}
+
+http_server_stats http_server::stats() const
+{
+    http_server_stats s;
+    auto add = [&s](const accept_counter &c) {
+        s.accept_wakeups += c.get_wakeups();
+        s.accepted += c.get_accepted();
+        s.max_accept_batch = std::max(s.max_accept_batch, c.get_max_batch());
+    };
+    add(accepts);
+    for (const auto &t : threads)
+        add(t->accepts);
+    return s;
+}
+
+int http_server::compile_routes()
+{
+    int ret = 0;
+    router.clear();
+    for (const auto &kv : handle_callbacks)
+    {
+        auto body = body_callbacks.find(kv.first);
+        if (router.add(kv.first, kv.second, body == body_callbacks.end() ? nullptr : body->second) == -1)
+            ret = -1;
+    }
+    return ret;
+}
+
+void http_server::stop()
+{
+    wake(stop_fd);
+}
+
 void http_server::wakeup(int i)
 {
     if (i > static_cast<int>(threads.size()))
@@ -88,6 +194,61 @@ void http_server::wakeup(int i)
     threads[i]->wakeup();
 }
 
+static const char *mime_type(const std::string &path)
+{
+    static const std::map<std::string, const char *> types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css"},
+        {"js", "application/javascript"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "text/xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"svg", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"}};
+
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+        return "application/octet-stream";
+    auto it = types.find(path.substr(dot + 1));
+    return it == types.end() ? "application/octet-stream" : it->second;
+}
+
+HandleCallBack static_file_handler(const std::string &root, const std::string &prefix)
+{
+    return [root, prefix](http_request *req) {
+        std::string path = req->uri;
+        if (!prefix.empty() && path.compare(0, prefix.size(), prefix) == 0)
+            path = path.substr(prefix.size());
+
+        /* nothing outside of root */
+        for (const auto &part : split(path, '/'))
+            if (part == "..")
+            {
+                req->send_not_found();
+                return;
+            }
+
+        path = root + "/" + path;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            path += "/index.html";
+
+        req->output_headers[HEADER_CONTENT_TYPE] = mime_type(path);
+        if (req->send_file(path) == -1)
+        {
+            req->output_headers.clear();
+            req->send_not_found();
+        }
+    };
+}
+
 /** private function */
 
 } // namespace eve
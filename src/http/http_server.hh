@@ -1,7 +1,7 @@
 #include <http_server_connection.hh>
+#include <http_router.hh>
 #include <thread_pool.hh>
 #include <epoll_base.hh>
-#include <lock_queue.hh>
 #include <http_server_thread.hh>
 
 #include <list>
@@ -13,20 +13,16 @@
 
 namespace eve
 {
-using HandleCallBack = std::function<void(http_request *)>;
-
 class rw_event;
 class epoll_base;
 
-class http_client_info
+struct http_server_stats
 {
-public:
-	int nfd;
-	int port;
-	std::string host;
+	size_t accept_wakeups = 0;   /* readiness callbacks of the listening sockets */
+	size_t accepted = 0;         /* connections accepted by them */
+	size_t max_accept_batch = 0; /* most connections accepted in one callback */
 
-public:
-	http_client_info(int nfd, std::string host, int port) : nfd(nfd), port(port), host(host) {}
+	inline double accepts_per_wakeup() const { return accept_wakeups ? (double)accepted / accept_wakeups : 0; }
 };
 
 class http_server
@@ -35,15 +31,23 @@ private:
 	std::shared_ptr<thread_pool> pool = nullptr;
 	std::shared_ptr<event_base> base = nullptr;
 	std::vector<std::unique_ptr<http_server_thread>> threads;
+	std::shared_ptr<rw_event> listener = nullptr;
+	std::shared_ptr<rw_event> stopper = nullptr; /* ends the loop of start(), on a dup of stop_fd */
+	int stop_fd = -1;                            /* eventfd of stop(), lives as long as the server */
+	size_t next_thread = 0;                      /* round robin of the accepting thread */
 
 public:
 	int timeout = -1;
-
-	lock_queue<std::unique_ptr<http_client_info>> clientQueue;
+	bool use_io_uring = false; /* backend of the threads created from now on */
+	bool reuse_port = false;   /* every thread accepts on its own SO_REUSEPORT socket */
+	int backlog = SOMAXCONN;   /* of each listening socket */
+	accept_counter accepts;    /* single acceptor mode */
 
 	std::function<void(http_request *)> gencb = nullptr;
 
 	std::map<std::string, HandleCallBack> handle_callbacks;
+	std::map<std::string, HandleCallBack> body_callbacks;
+	http_router router; /* compiled from handle_callbacks by start() */
 
 	std::string address;
 	int port;
@@ -55,6 +59,7 @@ public:
 	{
 		base = std::make_shared<epoll_base>();
 		pool = std::make_shared<thread_pool>();
+		stop_fd = create_eventfd();
 	}
 	~http_server();
 
@@ -66,16 +71,35 @@ public:
 		handle_callbacks[what] = cb;
 	}
 
+	/*
+	 * the body of requests to what goes to cb as it arrives, see
+	 * http_request::chunk_cb. the handler of what runs once it is all read.
+	 */
+	inline void set_body_cb(std::string what, HandleCallBack cb)
+	{
+		body_callbacks[what] = cb;
+	}
+
 	inline void set_gen_cb(HandleCallBack cb)
 	{
 		gencb = cb;
 	}
 
+	/* called by start(), handlers set after that are not seen. -1 if a pattern was rejected */
+	int compile_routes();
+
 	inline void set_timeout(int sec) { timeout = sec; }
+	inline void set_io_uring(bool on) { use_io_uring = on; }
+	inline void set_reuse_port(bool on) { reuse_port = on; }
+	inline void set_backlog(int n) { backlog = n; }
+
+	http_server_stats stats() const;
 
 	int start(const std::string &address, unsigned short port);
+	void stop(); /* from any thread, start() returns. before start() it returns at once */
 
 	void clean_connections();
+	bool hand_over(const http_client_info &client); /* to the next thread with room */
 	void wakeup(int i); // wakeup the ith thread in pool
 	void wakeup_random(int n)
 	{
@@ -92,4 +116,10 @@ public:
 private:
 };
 
+/* 
+ * a handler for set_handle_cb() serving the files below root. the uri with
+ * prefix cut off names the file, a directory is served by its index.html.
+ */
+HandleCallBack static_file_handler(const std::string &root, const std::string &prefix = "");
+
 } // namespace eve
@@ -6,31 +6,24 @@
 #include <sys/socket.h>
 
 #include <algorithm>
+#include <cstring>
 
 namespace eve
 {
 
-static void read_timeout_cb(http_server_connection *conn)
-{
-    LOG_WARN << "server connection read timeout " << conn->clientaddress << ":" << conn->clientport;
-    conn->fail(HTTP_TIMEOUT);
-}
-
-static void write_timeout_cb(http_server_connection *conn)
-{
-    LOG_WARN << "server connection write timeout " << conn->clientaddress << ":" << conn->clientport;
-    conn->fail(HTTP_TIMEOUT);
-}
-
 http_server_connection::http_server_connection(
     std::shared_ptr<event_base> base, int fd, http_server *server)
     : http_connection(base, fd), server(server)
 {
-    base->register_callback(readTimer, read_timeout_cb, this);
-    base->register_callback(writeTimer, write_timeout_cb, this);
     timeout = server->timeout;
 }
 
+void http_server_connection::reset()
+{
+    http_connection::reset();
+    reading = closing = processing = false;
+}
+
 void http_server_connection::fail(http_connection_error error)
 {
     LOG_WARN << "server connection fail on error=" << error << " state=" << state;
@@ -60,25 +53,28 @@ void http_server_connection::fail(http_connection_error error)
     case HTTP_INVALID_HEADER:
     default: /* xxx: probably should just error on default */
              /* the callback looks at the uri to determine errors */
-        auto req = current_request();
+        auto req = reading_request();
         if (!req)
             return;
         if (!req->uri.empty())
             req->uri = "";
         /* 
          * the callback needs to send a reply, once the reply has
-         * been send, the connection should get freed.
+         * been send, the connection should get freed. the requests
+         * before this one are answered first, nothing after it is read.
          */
         if (req->cb)
             req->cb(req);
-        handle_request(req);
+        reading = false;
+        closing = true;
+        process_requests();
         break;
     }
 }
 
 void http_server_connection::do_read_done()
 {
-    auto req = current_request();
+    auto req = reading_request();
     if (!req)
         return;
     if (req->handled)
@@ -87,9 +83,15 @@ void http_server_connection::do_read_done()
         return;
     }
 
-    start_write();
-    handle_request(req);
-    req->handled = true;
+    reading = false;
+    process_requests();
+}
+
+http_request *http_server_connection::reading_request()
+{
+    if (requests.empty())
+        return current_request();
+    return requests.back().get();
 }
 
 int http_server_connection::associate_new_request()
@@ -98,62 +100,131 @@ int http_server_connection::associate_new_request()
     req->flags |= REQ_OWN_CONNECTION;
 
     req->kind = REQUEST;
-    req->remote_host = clientaddress;
-    req->remote_port = clientport;
 
     requests.push(std::move(req));
+    reading = true;
 
     LOG << "<" << std::this_thread::get_id() << ">:"
-        << " get request from " << clientaddress << ":" << clientport;
+        << " get request on fd=" << fd();
 
     start_read();
 
     return 0;
 }
 
-void http_server_connection::handle_request(http_request *req)
+/*
+ * answers the requests in the order they came. a pipelining client
+ * sends several at once, all that are complete in the input buffer are
+ * parsed and queued, their responses pile up in the output and leave
+ * in one write. a response that comes later, from a timer or a chunked
+ * stream, holds up the ones behind it until do_write_done().
+ */
+void http_server_connection::process_requests()
 {
-    if (req->uri.empty())
-    {
-        req->send_error(HTTP_BADREQUEST, "Bad Request");
-        LOG_ERROR << "handle " << HTTP_BADREQUEST << " Bad Request";
+    if (processing) // the loop below picks up what changed
         return;
+    processing = true;
+    corked = true; // the responses of the loop leave together
+
+    while (!is_closed())
+    {
+        if (!requests.empty() && !(reading && requests.size() == 1))
+        {
+            auto req = current_request();
+            if (!req->handled)
+            {
+                /* a file being sent goes out behind the output buffer, nothing may be queued after it */
+                if (get_file_left() > 0)
+                    break;
+                req->handled = true;
+                handle_request(req);
+            }
+            if (!req->responded)
+                break;
+
+            bool need_close = req->is_connection_close();
+            pop_req();
+            if (need_close)
+            {
+                clear_requests();
+                reading = false;
+                closing = true;
+            }
+            continue;
+        }
+
+        /* read ahead only what is already here, an idle client waits for its answer */
+        if (closing || reading || requests.size() >= HTTP_MAX_PIPELINE ||
+            (!requests.empty() && get_ibuf_length() == 0))
+            break;
+        associate_new_request();
     }
 
-    LOG << "handle uri=" << req->uri;
+    processing = false;
+    corked = false;
+    if (is_closed())
+        return;
+    if (closing && requests.empty())
+        close(0);
+    else
+        start_write();
+}
+
+void http_server_connection::set_client_addr(const struct sockaddr *sa, socklen_t len)
+{
+    clientaddrlen = std::min<socklen_t>(len, sizeof(clientaddr));
+    std::memcpy(&clientaddr, sa, clientaddrlen);
+    clientaddress.clear();
+    clientport = -1;
+}
+
+std::string http_server_connection::peer_address()
+{
+    if (clientport == -1 && clientaddrlen > 0)
+        get_host_port((const struct sockaddr *)&clientaddr, clientaddrlen, clientaddress, clientport);
+    return clientaddress;
+}
+
+int http_server_connection::peer_port()
+{
+    peer_address();
+    return clientport;
+}
+
+/* the route is looked up with the head, a streaming one takes the body from there on */
+void http_server_connection::do_head_done(http_request *req)
+{
+    if (req->kind != REQUEST)
+        return;
 
     req->uri = string_from_utf8(req->uri);
-    size_t offset = req->uri.find("?");
+    size_t offset = req->uri.find('?');
     if (offset != std::string::npos)
     {
-        req->query = req->uri.substr(offset);
-        req->uri = req->uri.substr(0, offset);
+        req->query.assign(req->uri, offset, std::string::npos);
+        req->uri.resize(offset);
     }
 
-    if (server->handle_callbacks.count(req->uri) > 0)
+    req->route = server->router.match(req->uri, req->params);
+    if (req->route && req->route->body_cb)
+        req->chunk_cb = req->route->body_cb;
+}
+
+void http_server_connection::handle_request(http_request *req)
+{
+    if (req->uri.empty())
     {
-        server->handle_callbacks.at(req->uri)(req);
+        req->send_error(HTTP_BADREQUEST, "Bad Request");
+        LOG_ERROR << "handle " << HTTP_BADREQUEST << " Bad Request";
         return;
     }
 
-    for (const auto &kv : server->handle_callbacks)
+    LOG << "handle uri=" << req->uri;
+
+    if (req->route)
     {
-        auto v1 = split(kv.first, '/');
-        auto v2 = split(req->uri, '/');
-        if (v1.size() != v2.size())
-            continue;
-        bool flag = true;
-        for (int i = 0; i < static_cast<int>(v1.size()); i++)
-            if (v1[i] != v2[i] && v1[i] != "*")
-            {
-                flag = false;
-                break;
-            }
-        if (flag)
-        {
-            kv.second(req);
-            return;
-        }
+        req->route->cb(req);
+        return;
     }
 
     /* generic callback */
@@ -168,25 +239,14 @@ void http_server_connection::handle_request(http_request *req)
 
 void http_server_connection::do_write_done()
 {
-    auto req = current_request();
-    if (!req)
-        return;
-    if (req->chunked == 1)
-        return;
-
-    bool need_close =req->is_connection_close();
-
-    pop_req();
-
-    if (need_close)
+    if (closing && requests.empty())
     {
         close(0);
         return;
     }
 
-    /* we have a persistent connection; try to accept another request. */
-    if (associate_new_request() == -1)
-        close(1);
+    /* a late response went out, the requests behind it can go on */
+    process_requests();
 }
 
 } // namespace eve
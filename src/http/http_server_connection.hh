@@ -2,6 +2,11 @@
 
 #include <http_connection.hh>
 
+#include <sys/socket.h>
+
+/* requests read ahead of the one being answered */
+#define HTTP_MAX_PIPELINE 32
+
 namespace eve
 {
 
@@ -11,19 +16,36 @@ class http_server_connection : public http_connection
 public:
   http_server *server;
 
-  std::string clientaddress;
-  unsigned int clientport;
+private:
+  struct sockaddr_storage clientaddr;
+  socklen_t clientaddrlen = 0;
+  std::string clientaddress; /* printed from clientaddr when first asked for */
+  int clientport = -1;
+
+  bool reading = false;    /* the newest request is not read completely */
+  bool closing = false;    /* no more requests are taken, close once the output is out */
+  bool processing = false; /* process_requests() is on the stack */
 
 public:
   http_server_connection(std::shared_ptr<event_base> base, int fd, http_server* server);
   ~http_server_connection() {}
 
+  void reset();
   void fail(http_connection_error error);
   void do_read_done();
   void do_write_done();
+  void do_head_done(http_request *req);
+
+  void set_client_addr(const struct sockaddr *sa, socklen_t len);
+  std::string peer_address();
+  int peer_port();
 
   int associate_new_request();
+  void process_requests();
   void handle_request(http_request * req);
+
+protected:
+  http_request *reading_request();
 };
 
 } // namespace eve
@@ -1,6 +1,8 @@
 #include <http_server_thread.hh>
 #include <http_server.hh>
 #include <signal_event.hh>
+#include <io_uring_base.hh>
+#include <util_network.hh>
 
 namespace eve
 {
@@ -13,19 +15,34 @@ static void ev_sigpipe_handler(std::shared_ptr<signal_event> ev)
 http_server_thread::http_server_thread(http_server *server)
     : server(server)
 {
-    base = std::make_shared<epoll_base>();
+    if (server->use_io_uring)
+        base = std::make_shared<io_uring_base>(); // poll requests go with the wait in one io_uring_enter
+    else
+        base = std::make_shared<epoll_base>(true); // edge-triggered, keep-alive traffic needs no epoll_ctl
+    base->set_timer_backend(TIMER_WHEEL); // connection timers are re-armed on every read/write
 
     waker = create_event<rw_event>(base, create_eventfd(), READ);
     waker->set_persistent();
     base->register_callback(waker, get_connections, waker, this);
     base->add_event(waker);
 
+    /* writes use MSG_NOSIGNAL, sendfile() cannot and its SIGPIPE ends up here */
     ev_sigpipe = create_event<signal_event>(base, SIGPIPE);
     ev_sigpipe->set_persistent();
     base->register_callback(ev_sigpipe, ev_sigpipe_handler, ev_sigpipe);
     base->add_event(ev_sigpipe);
 }
 
+http_server_thread::~http_server_thread()
+{
+    base->clean_rw_event(waker);
+    if (listener)
+        base->clean_rw_event(listener); // its fd is closed with it
+    int fd = pending_listen.exchange(-1);
+    if (fd != -1)
+        closefd(fd);
+}
+
 void http_server_thread::loop()
 {
     base->loop();
@@ -36,6 +53,13 @@ void http_server_thread::terminate()
     base->set_terminated();
 }
 
+void http_server_thread::listen(int fd)
+{
+    /* the event is made by the thread itself on the next wakeup */
+    pending_listen = fd;
+    wakeup();
+}
+
 static int i = 0;
 std::unique_ptr<http_server_connection> http_server_thread::get_empty_connection()
 {
@@ -50,39 +74,75 @@ std::unique_ptr<http_server_connection> http_server_thread::get_empty_connection
     return conn;
 }
 
-void http_server_thread::get_connections(std::shared_ptr<rw_event> ev, http_server_thread *thread)
+void http_server_thread::release_closed()
 {
-    read_wake_msg(ev->fd);
-
-    auto i = thread->connectionList.begin();
-    while (i != thread->connectionList.end())
+    auto i = connectionList.begin();
+    while (i != connectionList.end())
     {
         bool isclosed = (*i)->is_closed();
         if (isclosed)
         {
             auto conn = std::move(*i);
-            i = thread->connectionList.erase(i);
+            i = connectionList.erase(i);
             conn->reset();
-            thread->emptyQueue.push(std::move(conn));
+            conn->clear_requests();
+            emptyQueue.push(std::move(conn));
             LOG_DEBUG << "release empty connection";
         }
         else
             i++;
     }
+}
+
+void http_server_thread::add_connection(const http_client_info &client)
+{
+    auto conn = get_empty_connection();
+    conn->set_fd(client.nfd);
+    conn->set_client_addr((const struct sockaddr *)&client.addr, client.addrlen);
+
+    if (conn->associate_new_request() != -1)
+        connectionList.push_back(std::move(conn));
+    else
+        emptyQueue.push(std::move(conn));
+}
 
-    std::unique_ptr<http_client_info> cinfo;
-    while (thread->server->clientQueue.pop(cinfo))
+void http_server_thread::get_connections(std::shared_ptr<rw_event> ev, http_server_thread *thread)
+{
+    read_wake_msg(ev->fd);
+
+    int lfd = thread->pending_listen.exchange(-1);
+    if (lfd != -1 && !thread->listener)
     {
-        auto conn = thread->get_empty_connection();
-        conn->set_fd(cinfo->nfd);
-        conn->clientaddress = cinfo->host;
-        conn->clientport = cinfo->port;
+        thread->listener = create_event<rw_event>(thread->base, lfd, READ);
+        thread->listener->set_persistent();
+        thread->base->register_callback(thread->listener, accept_connections, lfd, thread);
+        thread->base->add_event(thread->listener);
+        LOG << "[server] thread " << std::this_thread::get_id() << " accepting on fd=" << lfd;
+    }
 
-        if (conn->associate_new_request() != -1)
-            thread->connectionList.push_back(std::move(conn));
-        else
-            thread->emptyQueue.push(std::move(conn));
+    thread->release_closed();
+
+    http_client_info client;
+    while (thread->incoming.pop(client))
+        thread->add_connection(client);
+}
+
+/* reuse_port mode, no queue and no wakeup between accept and the connection */
+void http_server_thread::accept_connections(int fd, http_server_thread *thread)
+{
+    thread->release_closed();
+
+    /* drained until EAGAIN, an edge-triggered base reports the socket once */
+    http_client_info client;
+    size_t n = 0;
+    client.addrlen = sizeof(client.addr);
+    while ((client.nfd = accept_socket(fd, &client.addr, &client.addrlen)) != -1)
+    {
+        thread->add_connection(client);
+        client.addrlen = sizeof(client.addr);
+        n++;
     }
+    thread->accepts.record(n);
 }
 
 } // namespace eve
@@ -2,15 +2,49 @@
 
 #include <http_server_connection.hh>
 #include <epoll_base.hh>
+#include <spsc_queue.hh>
 #include <util_linux.hh>
 #include <logger.hh>
 
+#include <sys/socket.h>
+
+#include <atomic>
 #include <list>
 #include <queue>
 
 namespace eve
 {
 
+/* an accepted connection on its way to a thread, the address is printed there */
+struct http_client_info
+{
+  int nfd;
+  socklen_t addrlen;
+  struct sockaddr_storage addr;
+};
+
+/* accept() results per readiness callback of a listening socket, read from any thread */
+class accept_counter
+{
+private:
+  std::atomic<size_t> wakeups{0};
+  std::atomic<size_t> accepted{0};
+  std::atomic<size_t> max_batch{0};
+
+public:
+  inline void record(size_t n)
+  {
+    wakeups.fetch_add(1, std::memory_order_relaxed);
+    accepted.fetch_add(n, std::memory_order_relaxed);
+    if (n > max_batch.load(std::memory_order_relaxed))
+      max_batch.store(n, std::memory_order_relaxed); // one writer per counter
+  }
+
+  inline size_t get_wakeups() const { return wakeups.load(std::memory_order_relaxed); }
+  inline size_t get_accepted() const { return accepted.load(std::memory_order_relaxed); }
+  inline size_t get_max_batch() const { return max_batch.load(std::memory_order_relaxed); }
+};
+
 class http_server_thread
 {
 private:
@@ -18,23 +52,39 @@ private:
   http_server *server;
   std::shared_ptr<rw_event> waker;
   std::shared_ptr<signal_event> ev_sigpipe;
+  std::shared_ptr<rw_event> listener = nullptr; /* own SO_REUSEPORT socket in reuse_port mode */
+  std::atomic<int> pending_listen{-1};          /* handed over by http_server::start() */
+  spsc_queue<http_client_info, 256> incoming;   /* pushed by the accepting thread only */
   std::list<std::unique_ptr<http_server_connection>> connectionList;
   std::queue<std::unique_ptr<http_server_connection>> emptyQueue;
 
+public:
+  accept_counter accepts; /* reuse_port mode */
+
 public:
   http_server_thread(http_server *server);
-  ~http_server_thread()
-  {
-    base->clean_rw_event(waker);
-  }
+  ~http_server_thread();
 
   void loop();
   void wakeup() { wake(waker->fd); }
   void terminate();
+  void listen(int fd); /* accept on fd in this thread's loop */
+
+  /* false when the queue is full, the caller still owns the fd */
+  inline bool hand_over(const http_client_info &client)
+  {
+    if (!incoming.push(client))
+      return false;
+    wakeup();
+    return true;
+  }
 
 private:
   std::unique_ptr<http_server_connection> get_empty_connection();
+  void release_closed();
+  void add_connection(const http_client_info &client);
   static void get_connections(std::shared_ptr<rw_event> ev, http_server_thread *thread);
+  static void accept_connections(int fd, http_server_thread *thread);
 };
 
 } // namespace eve
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace eve
+{
+
+/** class spsc_queue **
+ *  bounded ring between exactly one producer thread and one consumer
+ *  thread. no lock and no allocation after construction, push() fails
+ *  when the ring is full. N has to be a power of two. **/
+template <typename T, size_t N>
+class spsc_queue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_queue size must be a power of two");
+
+  private:
+    T ring[N];
+    alignas(64) std::atomic<size_t> head{0}; /* next slot to pop, moved by the consumer */
+    alignas(64) std::atomic<size_t> tail{0}; /* next slot to push, moved by the producer */
+
+  public:
+    bool push(const T &v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        ring[t & (N - 1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &v)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        v = ring[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
+
+} // namespace eve
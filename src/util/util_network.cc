@@ -1,3 +1,4 @@
+#include <util_network.hh>
 #include <util_linux.hh>
 
 #include <unistd.h>
@@ -9,10 +10,12 @@
 
 #include <cstring>
 #include <iostream>
+#include <mutex>
 
 namespace eve
 {
 static struct addrinfo *__getaddrinfo(const std::string &address, unsigned short port);
+static int __shed_connection(int fd);
 
 int set_fd_nonblock(int fd)
 {
@@ -73,13 +76,13 @@ static struct addrinfo *__getaddrinfo(const std::string &address, unsigned short
     return aitop;
 }
 
-int bind_socket(const std::string &address, unsigned short port, int reuse)
+int bind_socket(const std::string &address, unsigned short port, int reuse, int reuse_port)
 {
     struct addrinfo *aitop = nullptr;
     int on;
 
     if (address.empty() && port == 0)
-        aitop = nullptr, reuse = 0; /* just create an unbound socket */
+        aitop = nullptr, reuse = reuse_port = 0; /* just create an unbound socket */
     else
     {
         aitop = __getaddrinfo(address, port);
@@ -95,6 +98,12 @@ int bind_socket(const std::string &address, unsigned short port, int reuse)
     setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
     if (reuse)
         setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(on));
+    /* every socket bound with it gets its share of the incoming connections */
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(on)) == -1)
+    {
+        LOG_ERROR << "SO_REUSEPORT error errno=" << errno;
+        goto out;
+    }
 
     if (aitop)
     {
@@ -120,10 +129,33 @@ out:
 int accept_socket(int fd, std::string &host, int &port)
 {
     struct sockaddr_storage ss_client;
-    struct sockaddr *sa = (struct sockaddr *)&ss_client;
     socklen_t client_addrlen = sizeof(ss_client);
 
-    int sockfd = accept(fd, (struct sockaddr *)&ss_client, &client_addrlen);
+    int sockfd = accept_socket(fd, &ss_client, &client_addrlen);
+    if (sockfd == -1)
+        return -1;
+
+    if (get_host_port((struct sockaddr *)&ss_client, client_addrlen, host, port) == -1)
+    {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/** @accept
+ *  return the nonblocking nfd, the peer address is left raw in addr
+ */
+int accept_socket(int fd, struct sockaddr_storage *addr, socklen_t *addrlen)
+{
+    /* nonblocking and close-on-exec from the start, no fcntl calls */
+    int sockfd;
+    while ((sockfd = accept4(fd, (struct sockaddr *)addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1 &&
+           (errno == EMFILE || errno == ENFILE))
+    {
+        if (__shed_connection(fd) == -1)
+            break;
+    }
 
     if (sockfd == -1)
     {
@@ -131,13 +163,43 @@ int accept_socket(int fd, std::string &host, int &port)
             LOG_ERROR << ": accept err errno=" << errno;
         return -1;
     }
-    if (set_fd_nonblock(sockfd) == -1)
+    return sockfd;
+}
+
+/*
+ * out of fds, the connection would stay in the backlog and an
+ * edge-triggered listener never hears of it again. an fd kept in
+ * reserve is given up to accept and close it, then taken back.
+ */
+static std::mutex reserve_mutex;
+static int reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC); // taken while fds are still there
+
+static int __shed_connection(int fd)
+{
+    std::lock_guard<std::mutex> lock(reserve_mutex);
+    if (reserve_fd == -1)
+        return -1;
+    close(reserve_fd);
+    int sockfd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    int err = errno;
+    if (sockfd != -1)
+        close(sockfd);
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (sockfd == -1)
+    {
+        errno = err;
         return -1;
+    }
+    LOG_WARN << ": out of fds, connection dropped on fd=" << fd;
+    return 0;
+}
 
+int get_host_port(const struct sockaddr *sa, socklen_t addrlen, std::string &host, int &port)
+{
     char ntop[NI_MAXHOST];
     char strport[NI_MAXSERV];
 
-    int ni_result = getnameinfo(sa, client_addrlen,
+    int ni_result = getnameinfo(sa, addrlen,
                                 ntop, sizeof(ntop), strport, sizeof(strport),
                                 NI_NUMERICHOST | NI_NUMERICSERV);
 
@@ -152,7 +214,7 @@ int accept_socket(int fd, std::string &host, int &port)
 
     host = std::string(ntop);
     port = std::stoi(strport);
-    return sockfd;
+    return 0;
 }
 
 int socket_connect(int fd, const std::string &address, unsigned short port)
@@ -190,9 +252,9 @@ std::pair<int, int> get_fdpair()
     return std::make_pair(pairfd[0], pairfd[1]);
 }
 
-int listenfd(int fd)
+int listenfd(int fd, int backlog)
 {
-    if (listen(fd, 128) == -1)
+    if (listen(fd, backlog) == -1)
     {
         LOG_ERROR << "listen error";
         close(fd);
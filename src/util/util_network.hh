@@ -1,3 +1,5 @@
+#include <sys/socket.h>
+
 #include <string>
 
 namespace eve
@@ -6,14 +8,16 @@ namespace eve
 int set_fd_nonblock(int fd);
 int get_nonblock_socket();
 
-int bind_socket(const std::string &address, unsigned short port, int reuse);
+int bind_socket(const std::string &address, unsigned short port, int reuse, int reuse_port = 0);
 int accept_socket(int fd, std::string &host, int &port);
+int accept_socket(int fd, struct sockaddr_storage *addr, socklen_t *addrlen);
+int get_host_port(const struct sockaddr *sa, socklen_t addrlen, std::string &host, int &port);
 int socket_connect(int fd, const std::string &address, unsigned short port);
 int http_connect(const std::string &address, unsigned short port);
 
 std::pair<int, int> get_fdpair();
 
-int listenfd(int fd);
+int listenfd(int fd, int backlog = 128);
 int check_socket(int socket);
 
 
@@ -0,0 +1,121 @@
+#include <http_server.hh>
+#include <util_network.hh>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace eve;
+
+static string host = "127.0.0.1";
+static int num_conns = 4000;
+static int num_clients = 8;
+
+static void reply_cb(http_request *req)
+{
+    auto buf = std::unique_ptr<buffer>(new buffer);
+    buf->push_back_string("ok");
+    req->send_reply(HTTP_OK, "OK", std::move(buf));
+}
+
+/* one connection, one request, the reply is read up to the close of the server */
+static bool one_connection(unsigned short port)
+{
+    static const char request[] = "GET / HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n";
+    int fd = http_connect(host, port);
+    if (fd == -1)
+        return false;
+    bool ok = write(fd, request, sizeof(request) - 1) == sizeof(request) - 1;
+
+    char buf[1024];
+    int n, got = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        got += n;
+    ok = ok && got > 0;
+
+    /* reset instead of close, no TIME_WAIT eats up the local ports */
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+    return ok;
+}
+
+static void run(bool reuse_port, int nthreads, unsigned short port)
+{
+    auto server = std::unique_ptr<http_server>(new http_server);
+    server->set_reuse_port(reuse_port);
+    server->resize_thread_pool(nthreads);
+    server->set_gen_cb(reply_cb);
+
+    std::thread loop([&server, port]() { server->start(host, port); });
+    usleep(200 * 1000); /* until every thread listens */
+
+    std::atomic<int> failed(0);
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < num_clients; c++)
+        clients.emplace_back([&failed, port, c]() {
+            for (int i = c; i < num_conns; i += num_clients)
+                if (!one_connection(port))
+                    failed++;
+        });
+    for (auto &t : clients)
+        t.join();
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+
+    server->stop();
+    loop.join();
+    auto stats = server->stats();
+    server.reset();
+
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << (reuse_port ? "reuse_port " : "handoff    ") << nthreads << " threads: "
+         << (long)(num_conns * 1000000.0 / us) << " connections/s, "
+         << stats.accepts_per_wakeup() << " accepts/wakeup (max " << stats.max_accept_batch << ")"
+         << (failed ? ", " + to_string(failed) + " failed" : "") << endl;
+}
+
+int main(int argc, char *const argv[])
+{
+    unsigned short port = 9300;
+
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:c:p:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_conns = atoi(optarg);
+            break;
+        case 'c':
+            num_clients = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    init_log_file("bench-accept.log");
+    for (int nthreads : {1, 4, 16})
+    {
+        run(false, nthreads, port++);
+        run(true, nthreads, port++);
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <epoll_base.hh>
+#include <buffer_event.hh>
+#include <util_network.hh>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+
+using namespace std;
+using namespace eve;
+
+static const int BLOCK_SIZE = 64 * 1024;
+static const int HIGH_WATER = 1024 * 1024; /* proxy stops reading above this much output */
+
+static long total;
+static long sent, received;
+static char block[BLOCK_SIZE], scratch[BLOCK_SIZE];
+
+/* source: pushes the body into the proxy as fast as the socket takes it */
+void source_cb(int fd, std::shared_ptr<rw_event> ev)
+{
+    while (sent < total)
+    {
+        int n = write(fd, block, std::min((long)BLOCK_SIZE, total - sent));
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+    ev->get_base()->clean_rw_event(ev);
+}
+
+/* sink: reads and throws the body away */
+void sink_cb(int fd, std::shared_ptr<event_base> base)
+{
+    int n;
+    while ((n = read(fd, scratch, sizeof(scratch))) > 0)
+        received += n;
+    if (received >= total)
+        base->set_terminated();
+}
+
+/* proxy: moves whatever arrived on in to out */
+void proxy_readcb(buffer_event *in, buffer_event *out)
+{
+    out->write_buffer(in->get_ibuf());
+    out->add_write_event();
+    if (out->get_obuf_length() > HIGH_WATER)
+        in->remove_read_event();
+}
+
+void proxy_writecb(buffer_event *in, buffer_event *out)
+{
+    if (out->get_obuf_length() <= HIGH_WATER / 2)
+        in->add_read_event();
+}
+
+static void run(buffer_mode mode, const char *name)
+{
+    auto base = std::make_shared<epoll_base>();
+
+    int src[2], dst[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, src) == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, dst) == -1)
+    {
+        cerr << "socketpair errno=" << errno << endl;
+        exit(1);
+    }
+    for (int fd : {src[0], src[1], dst[0], dst[1]})
+        set_fd_nonblock(fd);
+
+    auto source = create_event<rw_event>(base, src[0], WRITE);
+    source->set_persistent();
+    base->register_callback(source, source_cb, src[0], source);
+    base->add_event(source);
+
+    auto sink = create_event<rw_event>(base, dst[1], READ);
+    sink->set_persistent();
+    base->register_callback(sink, sink_cb, dst[1], base);
+    base->add_event(sink);
+
+    auto in = std::make_shared<buffer_event>(base, src[1], mode);
+    auto out = std::make_shared<buffer_event>(base, dst[0], mode);
+    in->register_readcb(proxy_readcb, in.get(), out.get());
+    out->register_writecb(proxy_writecb, in.get(), out.get());
+    in->add_read_event();
+
+    sent = received = 0;
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+    base->loop();
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << name << ": " << (received >> 20) << " MB proxied in " << (long)us << " microseconds, "
+         << (received / us) << " MB/s" << endl;
+
+    base->clean_rw_event(sink);
+}
+
+int main(int argc, char *const argv[])
+{
+    total = 256L << 20;
+
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "s:")) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            total = atol(optarg) << 20;
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < BLOCK_SIZE; i++)
+        block[i] = 'a' + i % 26;
+
+    run(BUFFER_CONTIGUOUS, "contiguous");
+    run(BUFFER_CHAINED, "chained");
+
+    return 0;
+}
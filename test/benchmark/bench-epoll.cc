@@ -0,0 +1,142 @@
+#include <epoll_base.hh>
+#include <buffer_event.hh>
+#include <util_network.hh>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace eve;
+
+static int num_pairs, num_rounds;
+static const int REQUEST_SIZE = 64, REPLY_SIZE = 256;
+static long completed;
+
+static char request[REQUEST_SIZE], reply[REPLY_SIZE];
+
+/* keep-alive server side: answer every complete request */
+void server_readcb(buffer_event *bev)
+{
+    char tmp[REQUEST_SIZE];
+    while (bev->get_ibuf_length() >= REQUEST_SIZE)
+    {
+        bev->read(tmp, REQUEST_SIZE);
+        bev->write(reply, REPLY_SIZE);
+    }
+}
+
+void client_readcb(buffer_event *bev, int *left, std::shared_ptr<event_base> base)
+{
+    char tmp[REPLY_SIZE];
+    while (bev->get_ibuf_length() >= REPLY_SIZE)
+    {
+        bev->read(tmp, REPLY_SIZE);
+        if (++completed == (long)num_pairs * num_rounds)
+            base->set_terminated();
+        if (--(*left) > 0)
+            bev->write(request, REQUEST_SIZE);
+    }
+}
+
+static void print_stats(const epoll_stats &st)
+{
+    cout << "  event array " << st.capacity << "/" << st.max_capacity
+         << ", grows " << st.grows << ", shrinks " << st.shrinks << ", full batches " << st.full << endl;
+    cout << "  batch sizes:";
+    for (int i = 0; i < epoll_stats::BUCKETS; i++)
+    {
+        if (!st.batches[i])
+            continue;
+        if (i == 0)
+            cout << " [0]=" << st.batches[i];
+        else
+            cout << " [" << (1 << (i - 1)) << "," << (1 << i) << ")=" << st.batches[i];
+    }
+    cout << endl;
+}
+
+static void run(bool edge_triggered, const char *name)
+{
+    auto base = std::make_shared<epoll_base>(edge_triggered);
+
+    vector<std::shared_ptr<buffer_event>> bevs;
+    vector<int> left(num_pairs, num_rounds);
+    for (int i = 0; i < num_pairs; i++)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        {
+            cerr << "socketpair errno=" << errno << endl;
+            exit(1);
+        }
+        set_fd_nonblock(pair[0]);
+        set_fd_nonblock(pair[1]);
+
+        auto client = std::make_shared<buffer_event>(base, pair[0]);
+        auto server = std::make_shared<buffer_event>(base, pair[1]);
+        client->register_readcb(client_readcb, client.get(), &left[i], base);
+        server->register_readcb(server_readcb, server.get());
+        client->add_read_event();
+        server->add_read_event();
+        bevs.push_back(client);
+        bevs.push_back(server);
+    }
+
+    completed = 0;
+    size_t ctl0 = base->ctl_count(), wait0 = base->wait_count(), saved0 = base->ctl_saved();
+
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+    for (int i = 0; i < num_pairs; i++)
+        bevs[2 * i]->write(request, REQUEST_SIZE);
+    base->loop();
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    double n = (double)completed;
+    cout << name << ": " << completed << " round trips in " << (long)us << " microseconds, "
+         << (us * 1000.0 / n) << " ns/round trip, "
+         << "epoll_ctl " << (base->ctl_count() - ctl0) / n << "/round trip ("
+         << (base->ctl_saved() - saved0) / n << " saved), "
+         << "epoll_wait " << (base->wait_count() - wait0) / n << "/round trip" << endl;
+    print_stats(base->stats());
+}
+
+int main(int argc, char *const argv[])
+{
+    num_pairs = 100;
+    num_rounds = 1000;
+
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_pairs = atoi(optarg);
+            break;
+        case 'r':
+            num_rounds = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < REQUEST_SIZE; i++)
+        request[i] = 'a' + i % 26;
+    for (int i = 0; i < REPLY_SIZE; i++)
+        reply[i] = 'A' + i % 26;
+
+    run(false, "level-triggered");
+    run(true, "edge-triggered");
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <epoll_base.hh>
+#include <http_connection.hh>
+#include <http_request.hh>
+#include <util_network.hh>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace eve;
+
+/* just enough of a connection to send replies on */
+class reply_connection : public http_connection
+{
+public:
+    reply_connection(std::shared_ptr<event_base> base, int fd) : http_connection(base, fd) {}
+
+    void fail(enum http_connection_error) {}
+    void do_read_done() {}
+    void do_write_done() {}
+};
+
+static int num_replies = 2000;
+static char scratch[256 * 1024];
+
+/* the body is a file: send_reply() of the file read into a buffer, or send_file() */
+static void run(size_t body_size, bool from_file, bool use_sendfile)
+{
+    auto base = std::make_shared<epoll_base>();
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+    {
+        cerr << "socketpair errno=" << errno << endl;
+        exit(1);
+    }
+    set_fd_nonblock(pair[0]);
+    set_fd_nonblock(pair[1]);
+
+    auto conn = std::make_shared<reply_connection>(base, pair[0]);
+    http_request req(conn.get());
+    req.type = REQ_GET;
+    std::vector<char> payload(body_size, 'x');
+
+    char path[] = "/tmp/bench-http-reply-XXXXXX";
+    if (from_file)
+    {
+        int fd = mkstemp(path);
+        if (fd == -1 || write(fd, payload.data(), payload.size()) != static_cast<ssize_t>(payload.size()))
+        {
+            cerr << "temp file errno=" << errno << endl;
+            exit(1);
+        }
+        close(fd);
+    }
+
+    size_t copied = 0, wire = 0;
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+    for (int i = 0; i < num_replies; i++)
+    {
+        /* everything copied after the handler built its body, reading a file included */
+        size_t c0 = buffer::copied_bytes();
+        if (use_sendfile)
+            req.send_file(path);
+        else
+        {
+            auto body = std::unique_ptr<buffer>(new buffer);
+            if (from_file)
+            {
+                int fd = open(path, O_RDONLY);
+                while (body->readfd(fd, -1) > 0)
+                    ;
+                close(fd);
+            }
+            else
+            {
+                body->push_back(payload.data(), payload.size());
+                c0 = buffer::copied_bytes();
+            }
+            req.send_reply(HTTP_OK, "OK", std::move(body));
+        }
+        while (conn->has_pending_output())
+        {
+            conn->write_out();
+            int n;
+            while ((n = read(pair[1], scratch, sizeof(scratch))) > 0)
+                wire += n;
+        }
+        copied += buffer::copied_bytes() - c0;
+        req.reset();
+    }
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << (use_sendfile ? "send_file " : from_file ? "read+send_reply " : "send_reply ")
+         << "body " << body_size << " bytes: " << (wire / num_replies) << " bytes/response on the wire, "
+         << (copied / num_replies) << " bytes copied/response, "
+         << (us * 1000.0 / num_replies) << " ns/response" << endl;
+
+    close(pair[1]);
+    if (from_file)
+        unlink(path);
+}
+
+int main(int argc, char *const argv[])
+{
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_replies = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    for (size_t size : {128, 4096, 65536, 1048576})
+        run(size, false, false);
+    for (size_t size : {4096, 65536, 1048576})
+    {
+        run(size, true, false);
+        run(size, true, true);
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <epoll_base.hh>
+#include <buffer_event.hh>
+#include <http_server.hh>
+#include <http_server_connection.hh>
+#include <util_network.hh>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace eve;
+
+static int num_pairs = 64, num_rounds = 2000;
+static long completed;
+
+static char request[] = "GET /ping HTTP/1.1\r\nHost: localhost\r\n\r\n";
+static const char body_end[] = "\r\n\r\npong";
+
+struct client
+{
+    shared_ptr<buffer_event> bev;
+    string in;
+    int left = 0;
+};
+
+static void ping_cb(http_request *req)
+{
+    static char pong[] = "pong";
+    auto body = unique_ptr<buffer>(new buffer);
+    body->push_back(pong, 4);
+    req->send_reply(HTTP_OK, "OK", std::move(body));
+}
+
+/* a response ends with its body, the next request goes out once it is in */
+static void client_readcb(client *c, shared_ptr<event_base> base)
+{
+    char tmp[4096];
+    int n;
+    while ((n = c->bev->read(tmp, sizeof(tmp))) > 0)
+        c->in.append(tmp, n);
+
+    size_t pos;
+    while ((pos = c->in.find(body_end)) != string::npos)
+    {
+        c->in.erase(0, pos + sizeof(body_end) - 1);
+        if (++completed == (long)num_pairs * num_rounds)
+            base->set_terminated();
+        if (--c->left > 0)
+            c->bev->write(request, sizeof(request) - 1);
+    }
+}
+
+int main(int argc, char *const argv[])
+{
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_pairs = atoi(optarg);
+            break;
+        case 'r':
+            num_rounds = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    /* as a server thread runs its connections */
+    auto base = make_shared<epoll_base>(true);
+    base->set_timer_backend(TIMER_WHEEL);
+
+    http_server server;
+    server.set_timeout(60); // never expires here, every request still arms and disarms it
+    server.set_handle_cb("/ping", ping_cb);
+    server.compile_routes();
+
+    vector<shared_ptr<http_server_connection>> conns;
+    vector<unique_ptr<client>> clients;
+    for (int i = 0; i < num_pairs; i++)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        {
+            cerr << "socketpair errno=" << errno << endl;
+            exit(1);
+        }
+        set_fd_nonblock(pair[0]);
+        set_fd_nonblock(pair[1]);
+
+        auto conn = make_shared<http_server_connection>(base, pair[0], &server);
+        conn->associate_new_request();
+        conns.push_back(conn);
+
+        auto cl = unique_ptr<client>(new client);
+        cl->bev = make_shared<buffer_event>(base, pair[1]);
+        cl->left = num_rounds;
+        cl->bev->register_readcb(client_readcb, cl.get(), base);
+        clients.push_back(std::move(cl));
+    }
+
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+    size_t ops0 = base->timer_ops();
+    for (auto &cl : clients)
+    {
+        cl->bev->add_read_event();
+        cl->bev->write(request, sizeof(request) - 1);
+    }
+    base->loop();
+    size_t ops = base->timer_ops() - ops0;
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+
+    if (completed != (long)num_pairs * num_rounds)
+    {
+        cerr << "FAILED " << completed << " responses" << endl;
+        exit(1);
+    }
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << num_pairs << " connections, " << completed << " keep-alive requests: "
+         << (double)ops / completed << " timer ops/request, "
+         << (us * 1000.0 / completed) << " ns/request" << endl;
+    return 0;
+}
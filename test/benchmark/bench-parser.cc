@@ -0,0 +1,149 @@
+#include <http_request.hh>
+#include <buffer.hh>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace eve;
+
+/* a browser GET of about 400 bytes */
+static const string REQUEST_TEXT =
+    "GET /static/css/site.min.css?v=1.4.2 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static int num_requests = 200000;
+
+/* the parsing as it was before http_parser: a string per line, split() and a substr per header */
+static int legacy_parse(buffer &buf, map<string, string> &headers)
+{
+    string line = buf.readline();
+    std::istringstream iss(line);
+    vector<string> words = split(line, ' ');
+    if (words.size() < 3 || (words[0] != "GET" && words[0] != "POST" && words[0] != "HEAD"))
+        return -1;
+    if (words[2] != "HTTP/1.0" && words[2] != "HTTP/1.1")
+        return -1;
+    string uri = words[1];
+
+    string k, v;
+    while (1)
+    {
+        line = buf.readline();
+        if (line.empty())
+            return 0;
+        if (line[0] == ' ' || line[0] == '\t')
+        {
+            ltrim(line, " \t");
+            v += line;
+            headers[k] = v;
+            continue;
+        }
+        auto pos = line.find(':', 0);
+        if (pos == string::npos)
+            continue;
+        k = line.substr(0, pos);
+        v = line.substr(pos + 1);
+        k = trim(k);
+        v = trim(v);
+        headers[k] = v;
+    }
+}
+
+static void report(const char *name, struct timeval *ts)
+{
+    struct timeval te, tv;
+    gettimeofday(&te, nullptr);
+    timersub(&te, ts, &tv);
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << name << ": " << (long)(num_requests * 1000000.0 / us) << " requests/s, "
+         << (us * 1000.0 / num_requests) << " ns/request" << endl;
+}
+
+int main(int argc, char *const argv[])
+{
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_requests = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    cout << REQUEST_TEXT.size() << " byte request, " << num_requests << " times" << endl;
+    struct timeval ts;
+
+    {
+        buffer buf;
+        map<string, string> headers;
+        gettimeofday(&ts, nullptr);
+        for (int i = 0; i < num_requests; i++)
+        {
+            buf.push_back_string(REQUEST_TEXT);
+            if (legacy_parse(buf, headers) == -1)
+                exit(1);
+            map<string, string>().swap(headers);
+        }
+        report("readline + split + map", &ts);
+    }
+
+    {
+        auto buf = std::unique_ptr<buffer>(new buffer);
+        http_request req;
+        gettimeofday(&ts, nullptr);
+        for (int i = 0; i < num_requests; i++)
+        {
+            buf->push_back_string(REQUEST_TEXT);
+            req.kind = REQUEST;
+            if (req.parse_firstline(buf) != ALL_DATA_READ || req.parse_headers(buf) != ALL_DATA_READ)
+                exit(1);
+            req.reset();
+        }
+        report("http_parser", &ts);
+    }
+
+    {
+        /* the request trickles in, every piece resumes the parse */
+        const size_t piece = 64;
+        auto buf = std::unique_ptr<buffer>(new buffer);
+        http_request req;
+        gettimeofday(&ts, nullptr);
+        for (int i = 0; i < num_requests; i++)
+        {
+            req.kind = REQUEST;
+            bool firstline = true;
+            for (size_t off = 0; off < REQUEST_TEXT.size(); off += piece)
+            {
+                buf->push_back((void *)(REQUEST_TEXT.data() + off), std::min(piece, REQUEST_TEXT.size() - off));
+                if (firstline && req.parse_firstline(buf) == ALL_DATA_READ)
+                    firstline = false;
+                if (!firstline && req.parse_headers(buf) == ALL_DATA_READ)
+                    break;
+            }
+            req.reset();
+        }
+        report("http_parser, 64 byte pieces", &ts);
+    }
+
+    return 0;
+}
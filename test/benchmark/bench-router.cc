@@ -0,0 +1,138 @@
+#include <http_router.hh>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace eve;
+
+static int num_lookups = 200000;
+static int num_resources = 250; // 4 routes each
+
+/* the dispatch of handle_request() before http_router: exact lookup, then split() every route */
+static const HandleCallBack *legacy_match(const map<string, HandleCallBack> &routes, const string &uri)
+{
+    auto it = routes.find(uri);
+    if (it != routes.end())
+        return &it->second;
+
+    for (const auto &kv : routes)
+    {
+        auto v1 = split(kv.first, '/');
+        auto v2 = split(uri, '/');
+        if (v1.size() != v2.size())
+            continue;
+        bool flag = true;
+        for (int i = 0; i < static_cast<int>(v1.size()); i++)
+            if (v1[i] != v2[i] && v1[i] != "*")
+            {
+                flag = false;
+                break;
+            }
+        if (flag)
+            return &kv.second;
+    }
+    return nullptr;
+}
+
+static void report(const char *name, int n, struct timeval *ts)
+{
+    struct timeval te, tv;
+    gettimeofday(&te, nullptr);
+    timersub(&te, ts, &tv);
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << name << ": " << (long)(n * 1000000.0 / us) << " lookups/s, "
+         << (us * 1000.0 / n) << " ns/lookup" << endl;
+}
+
+int main(int argc, char *const argv[])
+{
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_lookups = atoi(optarg);
+            break;
+        case 'r':
+            num_resources = atoi(optarg);
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    /* patterns the old dispatch understands too, "*" for the ids */
+    map<string, HandleCallBack> legacy;
+    http_router router;
+    int hits = 0;
+    for (int i = 0; i < num_resources; i++)
+    {
+        string res = "/api/v1/res" + to_string(i);
+        for (const string &p : {res, res + "/*", res + "/*/items", res + "/*/items/*"})
+        {
+            HandleCallBack cb = [&hits](http_request *) { hits++; };
+            legacy[p] = cb;
+            router.add(p, cb);
+        }
+    }
+
+    vector<string> uris;
+    for (int i = 0; i < 1024; i++)
+    {
+        string res = "/api/v1/res" + to_string((i * 7919) % num_resources);
+        switch (i % 4)
+        {
+        case 0:
+            uris.push_back(res);
+            break;
+        case 1:
+            uris.push_back(res + "/" + to_string(i));
+            break;
+        case 2:
+            uris.push_back(res + "/" + to_string(i) + "/items");
+            break;
+        default:
+            uris.push_back(res + "/" + to_string(i) + "/items/" + to_string(i * 3));
+            break;
+        }
+    }
+    cout << router.size() << " routes, " << num_lookups << " lookups" << endl;
+
+    /* both have to agree before anything is timed */
+    vector<route_param> params;
+    for (const auto &uri : uris)
+    {
+        const HandleCallBack *a = legacy_match(legacy, uri);
+        const http_route *b = router.match(uri, params);
+        if (!a || !b)
+        {
+            cerr << "FAILED no route for " << uri << endl;
+            exit(1);
+        }
+        (*a)(nullptr);
+        b->cb(nullptr);
+    }
+
+    struct timeval ts;
+    int legacy_lookups = num_lookups / 100; // it is that slow
+    gettimeofday(&ts, nullptr);
+    for (int i = 0; i < legacy_lookups; i++)
+        (*legacy_match(legacy, uris[i % uris.size()]))(nullptr);
+    report("map + split per route", legacy_lookups, &ts);
+
+    gettimeofday(&ts, nullptr);
+    for (int i = 0; i < num_lookups; i++)
+        router.match(uris[i % uris.size()], params)->cb(nullptr);
+    report("http_router", num_lookups, &ts);
+
+    return hits > 0 ? 0 : 1;
+}
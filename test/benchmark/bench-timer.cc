@@ -0,0 +1,130 @@
+#include <epoll_base.hh>
+#include <time_event.hh>
+
+#include <unistd.h>
+
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace eve;
+
+static int num_timers, num_rounds;
+static int fired;
+static bool coarse = false;
+
+void timer_cb()
+{
+    fired++;
+}
+
+static long elapsed_us(struct timeval *ts, struct timeval *te)
+{
+    struct timeval tv;
+    timersub(te, ts, &tv);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+/*
+ * every connection of a keep-alive server re-arms its timeout on each
+ * read and write, so mostly the timers are cancelled and inserted again
+ * long before they would fire
+ */
+static void rearm_round(std::shared_ptr<event_base> base, vector<std::shared_ptr<time_event>> *timers, int r)
+{
+    for (int i = 0; i < num_timers; i++)
+    {
+        auto &ev = (*timers)[i];
+        base->remove_event(ev);
+        ev->set_timer(30 + (i + r) % 30, (i * 7919 + r) % 1000000);
+        base->add_event(ev);
+    }
+}
+
+static void run(timer_backend backend, const char *name)
+{
+    auto base = std::make_shared<epoll_base>();
+    base->set_timer_backend(backend);
+    base->set_coarse_clock(coarse);
+
+    vector<std::shared_ptr<time_event>> timers(num_timers);
+    for (int i = 0; i < num_timers; i++)
+    {
+        timers[i] = create_event<time_event>(base);
+        base->register_callback(timers[i], timer_cb);
+        timers[i]->set_timer(30 + i % 30, (i * 7919) % 1000000);
+        base->add_event(timers[i]);
+    }
+
+    /* outside of the loop every set_timer() reads the clock */
+    struct timeval ts, te;
+    gettimeofday(&ts, nullptr);
+    for (int r = 0; r < num_rounds; r++)
+        rearm_round(base, &timers, r);
+    gettimeofday(&te, nullptr);
+    long fresh = elapsed_us(&ts, &te);
+
+    /* a round per loop iteration, the callback sees the time read once for it */
+    auto kick = create_event<time_event>(base);
+    gettimeofday(&ts, nullptr);
+    for (int r = 0; r < num_rounds; r++)
+    {
+        base->register_callback(kick, rearm_round, base, &timers, r);
+        kick->set_timer(0, 0);
+        base->add_event(kick);
+        base->loop_nonblock_and_once();
+    }
+    gettimeofday(&te, nullptr);
+    long cached = elapsed_us(&ts, &te);
+
+    /* let all of them time out at once */
+    fired = 0;
+    for (int i = 0; i < num_timers; i++)
+    {
+        base->remove_event(timers[i]);
+        timers[i]->set_timer(0, 0);
+        base->add_event(timers[i]);
+    }
+    usleep(2000);
+    gettimeofday(&ts, nullptr);
+    base->loop_nonblock_and_once();
+    gettimeofday(&te, nullptr);
+    long expire = elapsed_us(&ts, &te);
+
+    double ops = (double)num_timers * num_rounds;
+    cout << name << ": re-arm " << (fresh * 1000.0 / ops) << " ns/op reading the clock, "
+         << (cached * 1000.0 / ops) << " ns/op in a callback, "
+         << "expire " << num_timers << " timers in " << expire << " microseconds, fired=" << fired << endl;
+}
+
+int main(int argc, char *const argv[])
+{
+    num_timers = 100000;
+    num_rounds = 10;
+
+    int c;
+    extern char *optarg;
+    while ((c = getopt(argc, argv, "n:r:c")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            num_timers = atoi(optarg);
+            break;
+        case 'r':
+            num_rounds = atoi(optarg);
+            break;
+        case 'c': // CLOCK_MONOTONIC_COARSE
+            coarse = true;
+            break;
+        default:
+            cerr << "illegal argument" << endl;
+            exit(1);
+        }
+    }
+
+    run(TIMER_SET, "std::set");
+    run(TIMER_WHEEL, "timer_wheel");
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <epoll_base.hh>
+#include <io_uring_base.hh>
 #include <select_base.hh>
 #include <poll_base.hh>
 #include <rw_event.hh>
@@ -7,6 +8,7 @@
 #include <unistd.h>
 
 #include <vector>
+#include <string>
 
 using namespace std;
 using namespace eve;
@@ -35,11 +37,14 @@ void read_cb(int fd, int idx, int *count, int *writes, int *fired)
     }
 }
 
+static int ncallbacks; /* callbacks dispatched by the last run_once */
+
 struct timeval *
 run_once(void)
 {
     static int count = 0, fired = 0;
     int writes = num_writes;
+    int start = count;
     for (int *cp = pipes, i = 0; i < num_pipes; i++, cp += 2)
     {
         auto ev = vecrw[i];
@@ -72,6 +77,7 @@ run_once(void)
         cerr << "Xcount:" << xcount << ", Rcount:" << count << endl;
 
     timersub(&te, &ts, &te);
+    ncallbacks = count - start;
 
     return &te;
 }
@@ -81,10 +87,11 @@ int main(int argc, char *const argv[])
     num_pipes = 100;
     num_active = 2;
     num_writes = num_pipes / 2;
+    std::string backend = "epoll";
 
     int c;
     extern char *optarg;
-    while ((c = getopt(argc, argv, "n:a:w:")) != -1)
+    while ((c = getopt(argc, argv, "n:a:w:b:")) != -1)
     {
         switch (c)
         {
@@ -97,6 +104,9 @@ int main(int argc, char *const argv[])
         case 'w':
             num_writes = atoi(optarg);
             break;
+        case 'b':
+            backend = optarg;
+            break;
         default:
             cerr << "illegal argument" << endl;
             exit(1);
@@ -111,9 +121,19 @@ int main(int argc, char *const argv[])
         exit(1);
     }
 
-    pbase = std::make_shared<epoll_base>();
-    // pbase = std::make_shared<select_base>(); // max file descriptor is limited
-    // pbase = std::make_shared<poll_base>();
+    if (backend == "epoll")
+        pbase = std::make_shared<epoll_base>();
+    else if (backend == "uring")
+        pbase = std::make_shared<io_uring_base>();
+    else if (backend == "poll")
+        pbase = std::make_shared<poll_base>();
+    else if (backend == "select") // max file descriptor is limited
+        pbase = std::make_shared<select_base>();
+    else
+    {
+        cerr << "unknown backend " << backend << ", use epoll|uring|poll|select" << endl;
+        exit(1);
+    }
 
     pbase->priority_init(1);
 
@@ -135,14 +155,21 @@ int main(int argc, char *const argv[])
     cout << "pipes alloc finished\n";
 
     struct timeval *tv;
+    long total_us = 0, total_calls = 0;
     for (int i = 0; i < 25; i++)
     {
         cout << "run_once " << i + 1 << endl;
         tv = run_once();
         if (!tv)
             exit(1);
-        cout << "测试时间：" << (tv->tv_sec * 1000000L + tv->tv_usec)<< " microseconds" << endl;
+        long us = tv->tv_sec * 1000000L + tv->tv_usec;
+        cout << "测试时间：" << us << " microseconds, "
+             << (ncallbacks ? us * 1000.0 / ncallbacks : 0) << " ns/event" << endl;
+        total_us += us;
+        total_calls += ncallbacks;
     }
+    cout << "backend=" << backend << " pipes=" << num_pipes << " active=" << num_active << " writes=" << num_writes
+         << " dispatch cost: " << (total_calls ? total_us * 1000.0 / total_calls : 0) << " ns/event" << endl;
 
     delete[] pipes;
 
@@ -1,18 +1,25 @@
 #include <epoll_base.hh>
+#include <io_uring_base.hh>
 #include <select_base.hh>
 #include <poll_base.hh>
 #include <rw_event.hh>
 #include <time_event.hh>
 #include <signal_event.hh>
 #include <buffer_event.hh>
+#include <util_network.hh>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <utility>
+#include <vector>
 
 using namespace eve;
 using namespace std;
@@ -36,6 +43,11 @@ int setup_test(const char *name)
     //     cerr << "fcntl(O_NONBLOCK)\n";
     // if (fcntl(fdpair[1], F_SETFL, O_NONBLOCK) == -1)
     //     cerr << "fcntl(O_NONBLOCK)\n";
+    if (pbase->is_edge_triggered())
+    {
+        set_fd_nonblock(fdpair[0]);
+        set_fd_nonblock(fdpair[1]);
+    }
 
     test_ok = 0;
     called = 0;
@@ -492,6 +504,350 @@ void test10(void)
     cleanup_test();
 }
 
+/**************************************** test 11 - chained buffers ******************************/
+
+void test11_readcb(buffer_event *bev, buffer *out, int target)
+{
+    /* relinks the segments, the data is not copied */
+    out->push_back_buffer(bev->get_ibuf(), -1);
+    if (out->get_length() == target)
+        bev->remove_read_event();
+}
+
+void test11(void)
+{
+    setup_test("Chained Bufferevent:  ");
+
+    auto bev1 = std::make_shared<buffer_event>(pbase, fdpair[0], BUFFER_CHAINED);
+    auto bev2 = std::make_shared<buffer_event>(pbase, fdpair[1], BUFFER_CHAINED);
+    buffer out(BUFFER_CHAINED);
+
+    const int target = 100000;
+    std::vector<char> data(target);
+    for (int i = 0; i < target; i++)
+        data[i] = (char)(i * 7);
+
+    bev2->register_readcb(test11_readcb, bev2.get(), &out, target);
+    bev2->add_read_event();
+
+    for (int i = 0; i < target; i += 10000)
+        bev1->write(&data[i], 10000);
+
+    pbase->loop();
+
+    char head[100];
+    if (out.get_length() == target && out.pop_front(head, sizeof(head)) == sizeof(head) &&
+        memcmp(head, &data[0], sizeof(head)) == 0 &&
+        memcmp(out.get_data(), &data[sizeof(head)], target - sizeof(head)) == 0)
+        test_ok = 1;
+
+    cleanup_test();
+}
+
+/**************************************** test 12 - watermarks ******************************/
+
+struct test12_state
+{
+    std::vector<char> data;
+    size_t sent = 0;
+    size_t received = 0;
+    bool bad = false;
+};
+
+void test12_drainedcb(buffer_event *bev, test12_state *st)
+{
+    /* the producer fills up to the high mark and waits for the next drain */
+    while (st->sent < st->data.size() && !bev->write_full())
+    {
+        size_t n = std::min<size_t>(10000, st->data.size() - st->sent);
+        bev->write(&st->data[st->sent], n);
+        st->sent += n;
+    }
+}
+
+void test12_readcb(buffer_event *bev, test12_state *st, size_t high)
+{
+    /* nothing is consumed until the reading stopped at the high mark */
+    if (!bev->is_read_paused() && st->received + bev->get_ibuf_length() < st->data.size())
+        return;
+    if (static_cast<size_t>(bev->get_ibuf_length()) < high && st->received + bev->get_ibuf_length() < st->data.size())
+        st->bad = true;
+    std::vector<char> in(bev->get_ibuf_length());
+    bev->read(in.data(), in.size());
+    if (memcmp(in.data(), &st->data[st->received], in.size()) != 0)
+        st->bad = true;
+    st->received += in.size();
+    if (st->received == st->data.size())
+        bev->remove_read_event();
+}
+
+void test12(void)
+{
+    setup_test("Watermarks:  ");
+
+    auto bev1 = std::make_shared<buffer_event>(pbase, fdpair[0]);
+    auto bev2 = std::make_shared<buffer_event>(pbase, fdpair[1]);
+
+    const size_t high = 16384;
+    test12_state st;
+    st.data.resize(300000);
+    for (size_t i = 0; i < st.data.size(); i++)
+        st.data[i] = (char)(i * 13);
+
+    bev1->set_write_watermark(0, 65536);
+    bev1->register_drainedcb(test12_drainedcb, bev1.get(), &st);
+    bev2->set_read_watermark(1024, high);
+    bev2->register_readcb(test12_readcb, bev2.get(), &st, high);
+    bev2->add_read_event();
+
+    test12_drainedcb(bev1.get(), &st);
+
+    pbase->loop();
+
+    const buffer_event_stats &in = bev2->stats();
+    const buffer_event_stats &out = bev1->stats();
+    if (!st.bad && st.received == st.data.size() && in.read_pauses > 0 &&
+        in.bytes_read == st.data.size() && out.bytes_written == st.data.size() &&
+        out.drains > 1 && out.output_peak <= 65536 + 10000)
+        test_ok = 1;
+
+    cleanup_test();
+}
+
+/************************************ test 13 ***********************/
+/* many timers in and beyond the root wheel, one far away queued first, some cancelled or re-armed */
+
+struct test13_timer
+{
+    std::shared_ptr<time_event> ev;
+    int offset; /* ms after the start */
+    bool cancelled = false;
+};
+
+static struct timespec test13_start;
+static vector<int> test13_fired;
+static int test13_expected;
+static bool test13_bad;
+
+static int test13_elapsed()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - test13_start.tv_sec) * 1000 + (ts.tv_nsec - test13_start.tv_nsec) / 1000000;
+}
+
+void test13_cb(test13_timer *t)
+{
+    int ms = test13_elapsed();
+    if (t->cancelled || ms < t->offset - 1 || ms > t->offset + 100)
+    {
+        cerr << "timer of " << t->offset << " ms fired at " << ms << " ms" << endl;
+        test13_bad = true;
+    }
+    if (!test13_fired.empty() && test13_fired.back() > t->offset)
+        test13_bad = true;
+    test13_fired.push_back(t->offset);
+    if (static_cast<int>(test13_fired.size()) == test13_expected)
+        pbase->set_terminated();
+}
+
+void test13(void)
+{
+    setup_test("Timer order: ");
+
+    /* queued first, the others have to fire long before it */
+    auto far = create_event<time_event>(pbase);
+    far->set_timer(60, 0);
+    pbase->register_callback(far, timeout_cb, far);
+    pbase->add_event(far);
+
+    clock_gettime(CLOCK_MONOTONIC, &test13_start);
+    test13_fired.clear();
+    test13_bad = false;
+
+    const int n = 100;
+    vector<test13_timer> timers(n);
+    vector<int> order;
+    for (int k = 0; k < n; k++)
+        order.push_back((k * 37) % n); // not in timeout order
+    for (int k : order)
+    {
+        test13_timer *t = &timers[k];
+        t->offset = 5 + 7 * k; // up to 698 ms, past the 256 ms of the root wheel
+        t->ev = create_event<time_event>(pbase);
+        t->ev->set_timer(0, t->offset * 1000);
+        pbase->register_callback(t->ev, test13_cb, t);
+        pbase->add_event(t->ev);
+    }
+
+    test13_expected = n;
+    for (int k = 0; k < n; k++)
+    {
+        test13_timer *t = &timers[k];
+        if (k % 10 == 0)
+        {
+            t->cancelled = true;
+            pbase->remove_event(t->ev);
+            test13_expected--;
+        }
+        else if (k % 15 == 0) // re-armed while queued
+        {
+            t->offset += 3;
+            t->ev->set_timer(0, (t->offset - test13_elapsed()) * 1000);
+            pbase->add_event(t->ev);
+        }
+    }
+
+    pbase->loop();
+
+    test_ok = !test13_bad && static_cast<int>(test13_fired.size()) == test13_expected &&
+              std::is_sorted(test13_fired.begin(), test13_fired.end());
+
+    cleanup_test();
+}
+
+/************************************ test 14 ***********************/
+/* events bound into their own callbacks go away with the last outside reference */
+
+void test14_cb(std::shared_ptr<rw_event> ev)
+{
+    called++;
+    pbase->remove_event(ev);
+}
+
+void test14(void)
+{
+    setup_test("Callback self reference: ");
+
+    std::weak_ptr<rw_event> rw;
+    std::weak_ptr<time_event> timer;
+    int fd = dup(fdpair[1]);
+    {
+        auto ev = create_event<rw_event>(pbase, fd, READ);
+        pbase->register_callback(ev, test14_cb, ev);
+        pbase->add_event(ev);
+        rw = ev;
+
+        auto tev = create_event<time_event>(pbase);
+        tev->set_timer(0, 1000);
+        pbase->register_callback(tev, timeout_cb, tev);
+        pbase->add_event(tev);
+        timer = tev;
+    }
+    write(fdpair[0], "x", 1);
+    pbase->loop();
+
+    /* the rw_event closed its fd when it was destroyed */
+    test_ok = called == 1 && rw.expired() && timer.expired() && fcntl(fd, F_GETFD) == -1;
+
+    cleanup_test();
+}
+
+/************************************ test 15 ***********************/
+/* two loops wait for a signal in their own threads, one of them stops waiting */
+
+static std::atomic<int> test15_ready(0);
+static std::atomic<int> test15_caught(0);
+static std::atomic<bool> test15_done(false);
+
+void test15_signal_cb(std::shared_ptr<event_base> base)
+{
+    test15_caught++;
+    base->set_terminated();
+}
+
+void test15_remove_cb(std::shared_ptr<event_base> base, std::shared_ptr<signal_event> sev)
+{
+    base->remove_event(sev);
+    test15_ready++;
+}
+
+void test15_ready_cb()
+{
+    test15_ready++;
+}
+
+void test15_poll_cb(std::shared_ptr<event_base> base)
+{
+    if (test15_done)
+        base->set_terminated();
+}
+
+void test15(void)
+{
+    setup_test("Signal shared by threads: ");
+
+    auto a = std::make_shared<epoll_base>();
+    auto b = std::make_shared<epoll_base>();
+
+    /* a stops waiting for the signal once its loop runs */
+    auto asig = create_event<signal_event>(a, SIGUSR1);
+    a->register_callback(asig, test15_signal_cb, a);
+    a->add_event(asig);
+    auto aremove = create_event<time_event>(a);
+    aremove->set_timer(0, 1000);
+    a->register_callback(aremove, test15_remove_cb, a, asig);
+    a->add_event(aremove);
+    auto apoll = create_event<time_event>(a);
+    apoll->set_timer(0, 10000);
+    apoll->set_persistent();
+    a->register_callback(apoll, test15_poll_cb, a);
+    a->add_event(apoll);
+
+    auto bsig = create_event<signal_event>(b, SIGUSR1);
+    bsig->set_persistent();
+    b->register_callback(bsig, test15_signal_cb, b);
+    b->add_event(bsig);
+    auto bready = create_event<time_event>(b);
+    bready->set_timer(0, 1000);
+    b->register_callback(bready, test15_ready_cb);
+    b->add_event(bready);
+
+    std::thread ta([a]() { a->loop(); });
+    std::thread tb([b]() { b->loop(); });
+    while (test15_ready < 2)
+        usleep(1000);
+
+    /* the signal goes to b, it must not fall back to its default action */
+    kill(getpid(), SIGUSR1);
+    tb.join();
+    test15_done = true;
+    ta.join();
+
+    test_ok = test15_caught == 1;
+
+    cleanup_test();
+}
+
+/************************************ test 16 ***********************/
+/* a signal raised before the loop blocks it, the thread gets its mask and action back after */
+
+void test16_cb(std::shared_ptr<signal_event> ev)
+{
+    called++;
+    pbase->remove_event(ev);
+}
+
+void test16(void)
+{
+    setup_test("Early signal: ");
+
+    auto ev = create_event<signal_event>(pbase, SIGUSR2);
+    pbase->register_callback(ev, test16_cb, ev);
+    pbase->add_event(ev);
+    raise(SIGUSR2);
+
+    pbase->loop();
+
+    sigset_t mask;
+    struct sigaction sa;
+    pthread_sigmask(SIG_BLOCK, nullptr, &mask);
+    sigaction(SIGUSR2, nullptr, &sa);
+    test_ok = called == 1 && sigismember(&mask, SIGUSR2) == 0 && sa.sa_handler == SIG_DFL;
+
+    cleanup_test();
+}
+
 /**************************************** test priroties ******************************/
 
 void test_priorities_cb(std::shared_ptr<time_event> ev, int *count)
@@ -574,9 +930,59 @@ int main(int argc, char const *argv[])
 
     test10();
 
+    test11();
+
+    test12();
+
     test_priorities(1);
     test_priorities(2);
     test_priorities(3);
 
+    test13();
+
+    test14();
+
+    test15();
+
+    test16();
+
+    /* the timeouts once more on the timer wheel of the http server threads */
+    pbase->set_timer_backend(TIMER_WHEEL);
+
+    test6();
+
+    test8();
+
+    test13();
+
+    pbase->set_timer_backend(TIMER_SET);
+
+    /* buffer events drain the fds on edge-triggered epoll */
+    pbase = std::make_shared<epoll_base>(true);
+
+    test9();
+
+    test10();
+
+    test11();
+
+    test12();
+
+    /* level-triggered semantics on top of io_uring poll requests */
+    pbase = std::make_shared<io_uring_base>();
+
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+
     return 0;
 }
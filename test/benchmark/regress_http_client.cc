@@ -432,12 +432,89 @@ static void http_chunked_test(void)
     base->loop();
 }
 
+/* header names in lower case, as http/2 gateways and some clients send them */
+static void http_lowercase_readcb(buffer_event *bev)
+{
+    cout << __func__ << " called\n";
+    if (bev->get_ibuf()->find_string("This is funny") != nullptr)
+        bev->get_base()->set_terminated();
+}
+
+static void http_lowercase_header_test(void)
+{
+    cout << __func__ << endl;
+
+    int fd = http_connect(host, port);
+
+    auto base = make_shared<epoll_base>();
+    auto bev = make_shared<buffer_event>(base, fd);
+    bev->register_readcb(http_lowercase_readcb, bev.get());
+    bev->register_writecb(http_chunked_writecb, bev.get());
+    bev->register_errorcb(http_chunked_errorcb, bev.get());
+
+    /* without the content-length the server would wait for the close */
+    const string http_request =
+        "POST /postit HTTP/1.1\r\n"
+        "host: somehost\r\n"
+        "content-length: 11\r\n"
+        "\r\n"
+        "hello world";
+
+    bev->write_string(http_request);
+    bev->add_read_event();
+    bev->add_write_event();
+    base->loop();
+}
+
+static void http_route_done(http_request *req, const string &expected)
+{
+    cout << __func__ << " called\n";
+    string body(req->input_buffer->get_data(), req->input_buffer->get_length());
+    if (req->response_code != HTTP_OK || body != expected)
+    {
+        cerr << "FAILED (route) expected " << expected << " got " << body << endl;
+        exit(1);
+    }
+}
+
+/* static segments before parameters, parameters before wildcards */
+static void http_route_test(void)
+{
+    cout << __func__ << endl;
+    auto client = make_shared<http_client>();
+    auto conn = client->make_connection(host, port);
+
+    const vector<pair<string, string>> routes = {
+        {"/user/42/posts/7", "42 7 "},
+        {"/user/42/likes", "42  likes"},
+        {"/user/me/posts/latest", "dispatcher-test"},
+        {"/user/42/posts/7/", "42 7 "}, // a trailing '/' is dropped
+        {"/user/me/posts/latest/", "dispatcher-test"},
+        {"/user/me/posts/first", "me first "},
+    };
+    for (size_t i = 0; i < routes.size(); i++)
+    {
+        auto req = std::unique_ptr<http_request>(new http_request);
+        string expected = routes[i].second;
+        req->cb = [expected](http_request *req) { http_route_done(req, expected); };
+        req->output_headers["Host"] = "somehost";
+        if (i + 1 == routes.size())
+            req->output_headers["Connection"] = "close";
+        req->type = REQ_GET;
+        req->uri = routes[i].first;
+        conn->make_request(std::move(req));
+    }
+    client->run();
+}
+
 static void request_chunked_done(http_request *req)
 {
     cout << __func__ << " called\n";
-    if (req->input_buffer->find_string(CHUNKS[2]) != nullptr)
+    string body(req->input_buffer->get_data(), req->input_buffer->get_length());
+    if (body != CHUNKS[0] + CHUNKS[1] + CHUNKS[2])
     {
-        // base->set_terminated();
+        cerr << "FAILED (chunked body) " << body << endl;
+        exit(1);
     }
 }
 
@@ -458,6 +535,116 @@ static void http_chunked_handle_test(void)
     client->run();
 }
 
+/* the same chunks, taken one by one as they arrive */
+static void http_chunked_stream_test(void)
+{
+    cout << __func__ << endl;
+    auto client = make_shared<http_client>();
+    auto conn = client->make_connection(host, port);
+    auto req = std::unique_ptr<http_request>(new http_request);
+
+    auto pieces = make_shared<string>();
+    req->chunk_cb = [pieces](http_request *req) {
+        pieces->append(req->input_buffer->get_data(), req->input_buffer->get_length());
+    };
+    req->cb = [pieces](http_request *req) {
+        cout << "http_chunked_stream_done called\n";
+        if (*pieces != CHUNKS[0] + CHUNKS[1] + CHUNKS[2] || req->input_buffer->get_length() != 0)
+        {
+            cerr << "FAILED (streamed chunks) " << *pieces << endl;
+            exit(1);
+        }
+    };
+    req->output_headers["Connection"] = "close";
+    req->output_headers["Host"] = "somehost";
+    req->type = REQ_GET;
+    req->uri = "/chunked";
+
+    conn->make_request(std::move(req));
+    client->run();
+}
+
+/* what /upload answers for body */
+static string upload_answer(const string &body)
+{
+    unsigned long sum = 0;
+    for (unsigned char c : body)
+        sum += c;
+    return to_string(body.size()) + " " + to_string(sum);
+}
+
+static void http_upload_test(void)
+{
+    cout << __func__ << endl;
+    auto client = make_shared<http_client>();
+    auto conn = client->make_connection(host, port);
+
+    string body;
+    for (int i = 0; i < 1000000; i++)
+        body.push_back('a' + i % 26);
+    const string expected = upload_answer(body);
+
+    auto req = std::unique_ptr<http_request>(new http_request);
+    req->output_headers["Host"] = "somehost";
+    req->output_headers["Connection"] = "close";
+    req->output_buffer->push_back_string(body);
+    req->uri = "/upload";
+    req->type = REQ_POST;
+    req->cb = [expected](http_request *req) {
+        cout << "http_upload_done called\n";
+        string answer(req->input_buffer->get_data(), req->input_buffer->get_length());
+        if (req->response_code != HTTP_OK || answer != expected)
+        {
+            cerr << "FAILED (upload) expected " << expected << " got " << answer << endl;
+            exit(1);
+        }
+    };
+    conn->make_request(std::move(req));
+    client->run();
+}
+
+static string chunked_upload_expected;
+
+static void http_chunked_upload_readcb(buffer_event *bev)
+{
+    cout << __func__ << " called\n";
+    if (bev->get_ibuf()->find_string(chunked_upload_expected) != nullptr)
+        bev->get_base()->set_terminated();
+}
+
+/* a chunked body, cut at odd places on the way */
+static void http_chunked_upload_test(void)
+{
+    cout << __func__ << endl;
+
+    int fd = http_connect(host, port);
+
+    auto base = make_shared<epoll_base>();
+    auto bev = make_shared<buffer_event>(base, fd);
+    bev->register_readcb(http_chunked_upload_readcb, bev.get());
+    bev->register_writecb(http_chunked_writecb, bev.get());
+    bev->register_errorcb(http_chunked_errorcb, bev.get());
+
+    string body, request = "POST /upload HTTP/1.1\r\nHost: somehost\r\nTransfer-Encoding: chunked\r\n\r\n";
+    for (int size : {1, 4096, 70000, 13, 200000})
+    {
+        string chunk;
+        for (int i = 0; i < size; i++)
+            chunk.push_back('A' + (i * 7) % 26);
+        body += chunk;
+        char line[32];
+        snprintf(line, sizeof(line), "%x;ext=1\r\n", size);
+        request += line + chunk + "\r\n";
+    }
+    request += "0\r\nX-Trailer: yes\r\n\r\n";
+    chunked_upload_expected = upload_answer(body);
+
+    bev->write_string(request);
+    bev->add_read_event();
+    bev->add_write_event();
+    base->loop();
+}
+
 static int count_req = 1;
 static void keep_alive_cb(http_request *req)
 {
@@ -494,6 +681,60 @@ static void http_keepalive_test(void)
     client->run();
 }
 
+static void http_file_done(http_request *req)
+{
+    cout << __func__ << " called\n";
+    const int size = 300000; /* what regress_http_server wrote */
+
+    if (req->response_code != HTTP_OK || req->input_buffer->get_length() != size)
+    {
+        cerr << "FAILED (file) code=" << req->response_code << " length=" << req->input_buffer->get_length() << endl;
+        exit(1);
+    }
+
+    const char *data = req->input_buffer->get_data();
+    for (int i = 0; i < size; i++)
+        if (data[i] != 'a' + i % 26)
+        {
+            cerr << "FAILED (file content) at " << i << endl;
+            exit(1);
+        }
+}
+
+static void http_file_missing_done(http_request *req)
+{
+    cout << __func__ << " called\n";
+    if (req->response_code != HTTP_NOTFOUND)
+    {
+        cerr << "FAILED (missing file) code=" << req->response_code << endl;
+        exit(1);
+    }
+}
+
+static void http_file_test(void)
+{
+    cout << __func__ << endl;
+    auto client = make_shared<http_client>();
+    auto conn = client->make_connection(host, port);
+
+    auto req = std::unique_ptr<http_request>(new http_request);
+    req->set_cb(http_file_done);
+    req->output_headers["Host"] = "somehost";
+    req->type = REQ_GET;
+    req->uri = "/files/data.bin";
+    conn->make_request(std::move(req));
+
+    req = std::unique_ptr<http_request>(new http_request);
+    req->set_cb(http_file_missing_done);
+    req->output_headers["Host"] = "somehost";
+    req->output_headers["Connection"] = "close";
+    req->type = REQ_GET;
+    req->uri = "/files/missing.bin";
+    conn->make_request(std::move(req));
+
+    client->run();
+}
+
 int main(int argc, char const *argv[])
 {
     init_log_file("regress_http_client.log");
@@ -517,8 +758,18 @@ int main(int argc, char const *argv[])
 
     http_chunked_test();
     http_chunked_handle_test();
+    http_chunked_stream_test();
+
+    http_upload_test();
+    http_chunked_upload_test();
+
+    http_lowercase_header_test();
+
+    http_route_test();
 
     http_keepalive_test();
+
+    http_file_test();
     std::cout << "succeed\n";
     return 0;
 }
@@ -6,8 +6,16 @@
 #include <http_client.hh>
 #include <time_event.hh>
 
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 #include <iostream>
+#include <fstream>
+#include <map>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace eve;
@@ -15,6 +23,10 @@ using namespace eve;
 std::string host = "127.0.0.1";
 unsigned short port = 9102;
 
+/* served under /files/ by the static file handler */
+static const std::string FILE_DIR = "/tmp/regress_http_files";
+static const int FILE_SIZE = 300000;
+
 void http_test_cb(http_request *req)
 {
     cerr << __func__ << " called\n";
@@ -138,10 +150,89 @@ void http_keep_alive_cb(http_request *req)
     req->send_reply(HTTP_OK, "Everything is fine", std::move(buf));
 }
 
-static unique_ptr<http_server> http_setup()
+/* echoes the route parameters */
+void http_route_cb(http_request *req)
+{
+    auto buf = std::unique_ptr<buffer>(new buffer);
+    buf->push_back_string(req->get_param("id") + " " + req->get_param("post") + " " + req->get_param("*"));
+    req->send_reply(HTTP_OK, "Everything is fine", std::move(buf));
+}
+
+/** /upload takes the body as it comes and answers with its length and byte sum **/
+
+struct upload_state
+{
+    size_t bytes = 0;
+    unsigned long sum = 0;
+    int pieces = 0;
+};
+static std::map<http_request *, upload_state> uploads;
+
+static void http_upload_resume(std::shared_ptr<time_event>, http_request *req)
+{
+    req->resume_body();
+}
+
+void http_upload_body_cb(http_request *req)
+{
+    upload_state &st = uploads[req];
+    const unsigned char *data = (const unsigned char *)req->input_buffer->get_data();
+    for (int i = 0; i < req->input_buffer->get_length(); i++)
+        st.sum += data[i];
+    st.bytes += req->input_buffer->get_length();
+
+    /* a slow consumer now and then, the rest of the body has to wait */
+    if (++st.pieces % 4 == 0)
+    {
+        req->pause_body();
+        auto base = req->conn->get_base();
+        auto ev = create_event<time_event>(base);
+        ev->set_timer(0, 0);
+        base->register_callback(ev, http_upload_resume, ev, req);
+        base->add_event(ev);
+    }
+}
+
+void http_upload_cb(http_request *req)
+{
+    upload_state st = uploads[req];
+    uploads.erase(req);
+    auto buf = std::unique_ptr<buffer>(new buffer);
+    buf->push_back_string(std::to_string(st.bytes) + " " + std::to_string(st.sum));
+    req->send_reply(HTTP_OK, "Everything is fine", std::move(buf));
+}
+
+static void http_later_reply(std::shared_ptr<time_event>, http_request *req)
+{
+    auto buf = std::unique_ptr<buffer>(new buffer);
+    buf->push_back_string(req->uri);
+    req->send_reply(HTTP_OK, "Everything is fine", std::move(buf));
+}
+
+/* answers from the next loop iteration, the pipelined responses behind it have to wait */
+void http_later_cb(http_request *req)
+{
+    auto base = req->conn->get_base();
+    auto ev = create_event<time_event>(base);
+    ev->set_timer(0, 0);
+    base->register_callback(ev, http_later_reply, ev, req);
+    base->add_event(ev);
+}
+
+static void make_files()
+{
+    mkdir(FILE_DIR.c_str(), 0755);
+    std::ofstream out(FILE_DIR + "/data.bin", std::ios::binary | std::ios::trunc);
+    for (int i = 0; i < FILE_SIZE; i++)
+        out.put(static_cast<char>('a' + i % 26));
+}
+
+static unique_ptr<http_server> http_setup(bool io_uring, bool reuse_port)
 {
     cout << __func__ << endl;
     auto server = std::unique_ptr<http_server>(new http_server);
+    server->set_io_uring(io_uring);
+    server->set_reuse_port(reuse_port);
     server->resize_thread_pool(1);
     server->set_timeout(10);
 
@@ -151,14 +242,183 @@ static unique_ptr<http_server> http_setup()
     server->set_handle_cb("/largedelay", http_large_delay_cb);
     server->set_handle_cb("/", http_dispatcher_cb);
     server->set_handle_cb("/keep/*", http_keep_alive_cb);
+    server->set_handle_cb("/later", http_later_cb);
+    server->set_handle_cb("/upload", http_upload_cb);
+    server->set_body_cb("/upload", http_upload_body_cb);
+    server->set_handle_cb("/user/:id/posts/:post", http_route_cb);
+    server->set_handle_cb("/user/:id/*", http_route_cb);
+    server->set_handle_cb("/user/me/posts/latest", http_dispatcher_cb);
+
+    make_files();
+    server->set_handle_cb("/files/**", static_file_handler(FILE_DIR, "/files"));
 
     return server;
 }
 
+/** -p: pipelined load against this server, the answers have to come in order **/
+
+static const int PIPELINE_ROUNDS = 200;
+static const int PIPELINE_DEPTH = 64;
+
+static bool read_more(int fd, std::unique_ptr<buffer> &in)
+{
+    if (in->readfd(fd, -1) > 0)
+        return true;
+    cerr << "FAILED (pipeline connection closed)\n";
+    return false;
+}
+
+/* one response off the connection, its body ends up in res.input_buffer */
+static bool read_response(int fd, std::unique_ptr<buffer> &in, http_request &res)
+{
+    res.reset();
+    res.kind = RESPONSE;
+
+    enum message_read_status st;
+    while ((st = res.parse_firstline(in)) == MORE_DATA_EXPECTED)
+        if (!read_more(fd, in))
+            return false;
+    if (st != ALL_DATA_READ)
+        return false;
+    while ((st = res.parse_headers(in)) == MORE_DATA_EXPECTED)
+        if (!read_more(fd, in))
+            return false;
+    if (st != ALL_DATA_READ || res.get_body_length() == -1 || res.ntoread < 0)
+        return false;
+
+    while (in->get_length() < res.ntoread)
+        if (!read_more(fd, in))
+            return false;
+    res.input_buffer->push_back_buffer(in, res.ntoread);
+    return true;
+}
+
+static int pipeline_test()
+{
+    int fd = http_connect(host, port);
+    if (fd == -1)
+        return -1;
+
+    auto in = std::unique_ptr<buffer>(new buffer);
+    http_request res;
+    std::vector<std::string> uris;
+    struct timeval ts, te, tv;
+    gettimeofday(&ts, nullptr);
+
+    for (int r = 0; r < PIPELINE_ROUNDS; r++)
+    {
+        /* a whole round goes out in one write, now and then with a late answer in the middle */
+        std::string out;
+        uris.clear();
+        for (int i = 0; i < PIPELINE_DEPTH; i++)
+        {
+            uris.push_back(r % 50 == 0 && i == PIPELINE_DEPTH / 2 ? "/later" : "/keep/" + std::to_string(r) + "-" + std::to_string(i));
+            out += "GET " + uris.back() + " HTTP/1.1\r\nHost: somehost\r\n\r\n";
+        }
+        if (write(fd, out.data(), out.size()) != static_cast<ssize_t>(out.size()))
+        {
+            cerr << "FAILED (pipeline write)\n";
+            return -1;
+        }
+
+        for (const auto &uri : uris)
+        {
+            if (!read_response(fd, in, res) || res.response_code != HTTP_OK)
+            {
+                cerr << "FAILED (pipeline response for " << uri << ")\n";
+                return -1;
+            }
+            std::string body(res.input_buffer->get_data(), res.input_buffer->get_length());
+            if (body != uri)
+            {
+                cerr << "FAILED (pipeline order) expected " << uri << " got " << body << "\n";
+                return -1;
+            }
+        }
+    }
+
+    gettimeofday(&te, nullptr);
+    timersub(&te, &ts, &tv);
+    double us = tv.tv_sec * 1000000.0 + tv.tv_usec;
+    cout << PIPELINE_ROUNDS * PIPELINE_DEPTH << " pipelined requests, "
+         << (long)(PIPELINE_ROUNDS * PIPELINE_DEPTH * 1000000.0 / us) << " requests/s" << endl;
+    closefd(fd);
+    return 0;
+}
+
+/* size lines of a chunked body, only hex digits up to ';' or the line end are a size */
+static int chunk_size_test()
+{
+    struct
+    {
+        const char *line;
+        long size; /* -1 for corrupted */
+    } cases[] = {
+        {"5\r\n", 5},
+        {"1aF;ext=1\r\n", 0x1af},
+        {"a\n", 10},
+        {"\n5\r\n", -1},
+        {"+5\r\n", -1},
+        {"0x5\r\n", -1},
+        {" 5\r\n", -1},
+        {"5 \r\n", -1},
+        {"5\r\r\n", -1},
+        {";\r\n", -1},
+        {"fffffffffffffffff\r\n", -1},
+    };
+    for (const auto &c : cases)
+    {
+        http_request req;
+        req.ntoread = -1;
+        auto in = std::unique_ptr<buffer>(new buffer);
+        in->push_back_string(c.line);
+        enum message_read_status st = req.handle_chunked_read(in);
+        bool ok = c.size == -1 ? st == DATA_CORRUPTED : (st == MORE_DATA_EXPECTED && req.ntoread == c.size);
+        if (!ok)
+        {
+            cerr << "FAILED (chunk size line " << c.line << ")\n";
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char const *argv[])
 {
     init_log_file("regress_http_server.log");
-    auto server = http_setup();
+    /* -u serves on io_uring_base instead of epoll_base, -r accepts on SO_REUSEPORT sockets */
+    /* -p runs the pipeline test on a port of its own and exits */
+    bool io_uring = false, reuse_port = false, pipeline = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-u")
+            io_uring = true;
+        else if (std::string(argv[i]) == "-r")
+            reuse_port = true;
+        else if (std::string(argv[i]) == "-p")
+            pipeline = true;
+    }
+    auto server = http_setup(io_uring, reuse_port);
+    if (!pipeline)
+    {
+        server->start(host, port);
+        return 0;
+    }
+
+    if (chunk_size_test() == -1)
+        return 1;
+
+    port++;
+    int result = -1;
+    std::thread client([&server, &result]() {
+        usleep(200000); // until start() listens
+        result = pipeline_test();
+        server->stop();
+    });
     server->start(host, port);
+    client.join();
+    if (result == -1)
+        return 1;
+    cout << "pipeline succeed\n";
     return 0;
 }